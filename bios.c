@@ -1176,6 +1176,13 @@ TimerDuration bios_clock()
 	return get_coarse_time();
 }	
 
+TimerDuration bios_clock_ns()
+{
+	struct timespec curtime;
+	CHECK(clock_gettime(CLOCK_MONOTONIC, &curtime));
+	return curtime.tv_nsec + curtime.tv_sec*1000000000ull;
+}
+
 
 
 uint bios_serial_ports()
@@ -484,6 +484,19 @@ TimerDuration bios_cancel_timer();
 TimerDuration bios_clock();
 
 
+/**
+	@brief Get the current time from the high-resolution clock.
+
+	This function returns the value of a monotonic clock, in nanoseconds,
+	with the resolution of the host's clock (typically, much better than
+	a microsecond). The value is not related to any particular epoch, it
+	is only meaningful to compute time intervals.
+
+	@see bios_clock
+ */
+TimerDuration bios_clock_ns();
+
+
 
 
 /**
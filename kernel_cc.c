@@ -1,6 +1,7 @@
 
 
 #include <assert.h>
+#include <string.h>
 
 #include "kernel_sched.h"
 #include "kernel_proc.h"
@@ -19,6 +20,155 @@
   */
 
 
+/*
+	Lock statistics.
+	----------------
+
+	When the kernel is compiled with LOCK_STATISTICS defined (e.g., by 
+	'make LOCK_STATISTICS=1'), every Mutex_Lock, Mutex_Unlock and condition
+	wait is instrumented. Statistics are kept per lock site, that is, per pair
+	(mutex address, calling code address). For each site we count the 
+	acquisitions, the contended acquisitions, the spin iterations and the 
+	calls to yield(SCHED_MUTEX), as well as the time spent waiting for the
+	mutex and holding it. Condition waits are counted separately, with their
+	blocking time.
+
+	The statistics table is a fixed-size, open-addressing hash table that is
+	updated using only atomics (it cannot use Mutex, obviously). When it fills
+	up, new sites are simply not recorded; the number of dropped sites is 
+	reported.
+
+	The report is printed by lock_statistics_report(), at the end of boot().
+ */
+#if defined(LOCK_STATISTICS)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#define LOCKSTAT_SLOTS 4096
+
+typedef struct lockstat_rec {
+	int claimed;				/* slot is taken */
+	int ready;					/* key fields are valid */
+	Mutex* lock;				/* the mutex */
+	void* site;					/* the code address, or NULL for the holder record */
+
+	unsigned long acquisitions;	/* number of Mutex_Lock */
+	unsigned long contended;	/* number of Mutex_Lock that did not succeed at once */
+	unsigned long spins;		/* spin iterations */
+	unsigned long yields;		/* yield(SCHED_MUTEX) calls */
+	unsigned long cond_waits;	/* number of condition waits */
+	uint64_t wait_ns;			/* total time waiting to acquire */
+	uint64_t hold_ns;			/* total time holding */
+	uint64_t cond_ns;			/* total time blocked in condition waits */
+
+	/* Only for holder records (site==NULL) */
+	uint64_t acquired_at;		/* time of last acquisition */
+	struct lockstat_rec* holder;	/* site record of last acquisition */
+} lockstat_rec;
+
+static lockstat_rec lockstat_table[LOCKSTAT_SLOTS];
+static unsigned long lockstat_dropped;
+
+static inline uint64_t lockstat_now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1000000000ull + t.tv_nsec;
+}
+
+/* 
+	Find (or create) the record for (lock, site). Returns NULL if the
+	table is full.
+ */
+static lockstat_rec* lockstat_find(Mutex* lock, void* site)
+{
+	uintptr_t h = ((uintptr_t)lock * 0x9E3779B97F4A7C15ull) ^ ((uintptr_t)site >> 2);
+	for(unsigned probe=0; probe < LOCKSTAT_SLOTS; probe++) {
+		lockstat_rec* rec = & lockstat_table[(h + probe) % LOCKSTAT_SLOTS];
+
+		if(! __atomic_load_n(&rec->claimed, __ATOMIC_ACQUIRE)) {
+			int zero = 0;
+			if(__atomic_compare_exchange_n(&rec->claimed, &zero, 1, 0, 
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				rec->lock = lock;
+				rec->site = site;
+				__atomic_store_n(&rec->ready, 1, __ATOMIC_RELEASE);
+				return rec;
+			}
+		}
+
+		/* The slot is claimed, wait until its key is valid */
+		while(! __atomic_load_n(&rec->ready, __ATOMIC_ACQUIRE));
+		if(rec->lock == lock && rec->site == site) return rec;
+	}
+	__atomic_fetch_add(&lockstat_dropped, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+#define LOCKSTAT_ADD(rec, field, val) \
+	do { if(rec) __atomic_fetch_add(&(rec)->field, (val), __ATOMIC_RELAXED); } while(0)
+
+
+static int lockstat_compare(const void* a, const void* b)
+{
+	const lockstat_rec* ra = *(const lockstat_rec**) a;
+	const lockstat_rec* rb = *(const lockstat_rec**) b;
+	uint64_t ka = ra->wait_ns + ra->cond_ns;
+	uint64_t kb = rb->wait_ns + rb->cond_ns;
+	return (ka < kb) - (ka > kb);
+}
+
+void lock_statistics_report()
+{
+	static lockstat_rec* sorted[LOCKSTAT_SLOTS];
+	size_t n = 0;
+
+	for(size_t i=0; i<LOCKSTAT_SLOTS; i++) {
+		lockstat_rec* rec = & lockstat_table[i];
+		if(rec->ready && rec->site != NULL)
+			sorted[n++] = rec;
+	}
+	qsort(sorted, n, sizeof(lockstat_rec*), lockstat_compare);
+
+	fprintf(stderr, "Lock statistics (%zu sites, %lu dropped), by total wait time:\n", 
+		n, lockstat_dropped);
+	fprintf(stderr, "%18s %18s %10s %10s %12s %8s %12s %12s %8s %12s\n",
+		"lock", "site", "acq", "contended", "spins", "yields", 
+		"wait(us)", "hold(us)", "cwaits", "cwait(us)");
+	for(size_t i=0; i<n; i++) {
+		lockstat_rec* rec = sorted[i];
+
+		/* Print sites as offsets into their object, suitable for addr2line */
+		char site[64];
+		Dl_info info;
+		if(dladdr(rec->site, &info) && info.dli_sname)
+			snprintf(site, sizeof(site), "%s+%#tx", info.dli_sname, 
+				(char*)rec->site - (char*)info.dli_saddr);
+		else if(dladdr(rec->site, &info))
+			snprintf(site, sizeof(site), "%#tx", (char*)rec->site - (char*)info.dli_fbase);
+		else
+			snprintf(site, sizeof(site), "%p", rec->site);
+
+		fprintf(stderr, "%18p %18s %10lu %10lu %12lu %8lu %12.1f %12.1f %8lu %12.1f\n",
+			(void*)rec->lock, site, rec->acquisitions, rec->contended,
+			rec->spins, rec->yields, rec->wait_ns*1E-3, rec->hold_ns*1E-3,
+			rec->cond_waits, rec->cond_ns*1E-3);
+	}
+}
+
+void lock_statistics_reset()
+{
+	memset(lockstat_table, 0, sizeof(lockstat_table));
+	lockstat_dropped = 0;
+}
+
+#endif /* LOCK_STATISTICS */
+
+
+
 /*
  	Pre-emption aware mutex.
  	-------------------------
@@ -29,37 +179,157 @@
  	Therefore, we can call the same function from both the preemptive and
  	the non-preemptive domain of the kernel.
 
+ 	In the preemptive domain, spinning is adaptive. A waiter keeps spinning
+ 	only while the owner is the current thread of its core, and the mutex 
+ 	has not been held for much longer than its average hold time. Mutexes 
+ 	which are held for longer than a context switch costs, on average, are 
+ 	not spun on at all.
+
+ 	The owner and the hold times are kept outside the Mutex, which is just a
+ 	byte, in a direct-mapped table of hints indexed by the mutex address. 
+ 	A mutex takes a slot when it is contended, and then its lock and unlock
+ 	operations keep the slot up to date, until some other contended mutex
+ 	with the same hash takes it over. Thus, uncontended mutexes only pay 
+ 	for one table lookup. Times are measured in nanoseconds.
+
+ 	The hints are read and written without synchronization. A waiter that
+ 	does not find a valid hint for its mutex yields.
+
  	The implementation is based on GCC atomics, as the standard C11 primitives
  	are not supported by all recent compilers. Eventually, this will change.
  */
+
+#define MUTEX_HINT_SLOTS 1024
+
+typedef struct mutex_hint {
+	Mutex* lock;				/* the mutex using this slot, or NULL */
+	TCB* owner;					/* the owner of the mutex, or NULL */
+	unsigned int core;			/* the core of the owner, when it locked the mutex */
+	unsigned int hold_avg;		/* moving average of the hold time, in ns */
+	TimerDuration acquired_at;	/* the time the mutex was locked */
+} mutex_hint;
+
+static mutex_hint mutex_hints[MUTEX_HINT_SLOTS];
+
+static inline mutex_hint* mutex_hint_slot(Mutex* lock)
+{
+	uintptr_t h = ((uintptr_t)lock * 0x9E3779B97F4A7C15ull) >> 32;
+	return & mutex_hints[h % MUTEX_HINT_SLOTS];
+}
+
+/* Do not spin on mutexes held on average for longer than this (in ns) */
+#define MUTEX_SPIN_MAX  10000ul
+
+/* Allowed slack over the average hold time, before we give up spinning (in ns) */
+#define MUTEX_SPIN_SLACK  1000ul
+
+/* Return 1 if it is worth spinning for the mutex, 0 if we should yield */
+static inline int mutex_spin_worthwhile(Mutex* lock, mutex_hint* hint)
+{
+	if(__atomic_load_n(& hint->lock, __ATOMIC_RELAXED) != lock)
+		return 0;
+
+	TCB* owner = __atomic_load_n(& hint->owner, __ATOMIC_RELAXED);
+	uint core = __atomic_load_n(& hint->core, __ATOMIC_RELAXED);
+	if(owner == NULL || core >= cpu_cores() 
+		|| __atomic_load_n(& cctx[core].current_thread, __ATOMIC_RELAXED) != owner)
+		return 0;
+
+	unsigned long avg = __atomic_load_n(& hint->hold_avg, __ATOMIC_RELAXED);
+	if(avg > MUTEX_SPIN_MAX) 
+		return 0;
+
+	TimerDuration held = bios_clock_ns() - __atomic_load_n(& hint->acquired_at, __ATOMIC_RELAXED);
+	return held < 2*avg + MUTEX_SPIN_SLACK;
+}
+
 void Mutex_Lock(Mutex* lock)
 {
-#define MUTEX_SPINS (cpu_cores()>1 ?  1000 : 10000)
+#if defined(LOCK_STATISTICS)
+  lockstat_rec* rec = lockstat_find(lock, __builtin_return_address(0));
+  uint64_t t0 = lockstat_now();
+  int contended = 0;
+#endif
+  mutex_hint* hint = mutex_hint_slot(lock);
 
-  while(__atomic_test_and_set(lock,__ATOMIC_ACQUIRE)) {
-    int spin=MUTEX_SPINS;
+  while(__atomic_test_and_set(lock, __ATOMIC_ACQUIRE)) {
+#if defined(LOCK_STATISTICS)
+    contended = 1;
+#endif
+    /* Keep hints for this mutex from now on */
+    if(__atomic_load_n(& hint->lock, __ATOMIC_RELAXED) != lock) {
+      __atomic_store_n(& hint->owner, NULL, __ATOMIC_RELAXED);
+      __atomic_store_n(& hint->hold_avg, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(& hint->lock, lock, __ATOMIC_RELAXED);
+    }
+
+    int may_yield = cpu_interrupts_enabled();
     while(__atomic_load_n(lock, __ATOMIC_RELAXED)) {
 #if defined(__x86__) || defined(__x86_64__)
       __builtin_ia32_pause();
 #endif
-      if(spin>0) 
-      	spin--; 
-      else { 
-      	spin=MUTEX_SPINS; 
-      	if(cpu_interrupts_enabled())
-      		yield(SCHED_MUTEX); 
+#if defined(LOCK_STATISTICS)
+      LOCKSTAT_ADD(rec, spins, 1);
+#endif
+      if(may_yield && ! mutex_spin_worthwhile(lock, hint)) {
+#if defined(LOCK_STATISTICS)
+        LOCKSTAT_ADD(rec, yields, 1);
+#endif
+        yield(SCHED_MUTEX); 
       }
     }
   }
-#undef MUTEX_SPINS
+
+  /* We own the lock */
+  if(__atomic_load_n(& hint->lock, __ATOMIC_RELAXED) == lock) {
+    __atomic_store_n(& hint->core, cpu_core_id, __ATOMIC_RELAXED);
+    __atomic_store_n(& hint->acquired_at, bios_clock_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(& hint->owner, cctx[cpu_core_id].current_thread, __ATOMIC_RELAXED);
+  }
+
+#if defined(LOCK_STATISTICS)
+  uint64_t t1 = lockstat_now();
+  LOCKSTAT_ADD(rec, acquisitions, 1);
+  LOCKSTAT_ADD(rec, contended, contended);
+  LOCKSTAT_ADD(rec, wait_ns, t1-t0);
+
+  /* We own the lock, so we own its holder record */
+  lockstat_rec* hrec = lockstat_find(lock, NULL);
+  if(hrec) {
+    hrec->acquired_at = t1;
+    hrec->holder = rec;
+  }
+#endif
 }
 
 
 void Mutex_Unlock(Mutex* lock)
 {
+#if defined(LOCK_STATISTICS)
+  lockstat_rec* hrec = lockstat_find(lock, NULL);
+  if(hrec && hrec->holder) {
+    LOCKSTAT_ADD(hrec->holder, hold_ns, lockstat_now() - hrec->acquired_at);
+    hrec->holder = NULL;
+  }
+#endif
+
+  mutex_hint* hint = mutex_hint_slot(lock);
+  if(__atomic_load_n(& hint->lock, __ATOMIC_RELAXED) == lock
+      && __atomic_load_n(& hint->owner, __ATOMIC_RELAXED) != NULL) {
+    /* Update the moving average of the hold time, with weight 1/8 */
+    TimerDuration held = bios_clock_ns() - __atomic_load_n(& hint->acquired_at, __ATOMIC_RELAXED);
+    unsigned long avg = __atomic_load_n(& hint->hold_avg, __ATOMIC_RELAXED);
+    avg = avg - (avg >> 3) + (held >> 3);
+    __atomic_store_n(& hint->hold_avg, (avg > UINT32_MAX) ? UINT32_MAX : avg, __ATOMIC_RELAXED);
+    __atomic_store_n(& hint->owner, NULL, __ATOMIC_RELAXED);
+  }
+
   __atomic_clear(lock, __ATOMIC_RELEASE);
 }
 
+#undef MUTEX_SPIN_MAX
+#undef MUTEX_SPIN_SLACK
+
 
 /*
 	Condition variables.	
@@ -73,6 +343,8 @@ typedef struct __cv_waiter {
 	sig_atomic_t signalled;		/* this is set if the thread is signalled */
 	sig_atomic_t removed;		/* this is set if the waiter is removed 
 								   from the ring */
+	sig_atomic_t morphed;		/* this is set if the waiter is in a 
+								   hand-off chain (see Cond_Broadcast) */
 } __cv_waiter;
 /** \endcond */
 
@@ -91,6 +363,15 @@ static inline void remove_from_ring(CondVar* cv, __cv_waiter* w)
 }
 
 
+/* Publish the lock that a killable wait holds while it decides to sleep */
+static void set_wait_lock(TCB* tcb, Mutex* mx)
+{
+	Mutex_Lock(& tcb->wait_guard);
+	tcb->wait_lock = mx;
+	Mutex_Unlock(& tcb->wait_guard);
+}
+
+
 /** 
    @internal
    @brief Wait on a condition variable, specifying the cause. 
@@ -108,10 +389,14 @@ static inline void remove_from_ring(CondVar* cv, __cv_waiter* w)
   because the thread was awoken by another kernel routine), 
   it first re-locks the mutex and then returns.  
 
+  If @c killable is set and the process of the thread has been killed, 
+  the thread does not sleep, or it is woken up by @c kernel_interrupt.
+
   @param mx The mutex to be unlocked as the thread sleeps.
   @param cv The condition variable to sleep on.
   @param cause A cause provided to the kernel scheduler.
   @param timeout The time to sleep, or @c NO_TIMEOUT to sleep for ever.
+  @param killable Whether the wait is interrupted when the process is killed.
 
   @returns 1 if this thread was woken up by signal/broadcast, 0 otherwise
 
@@ -119,11 +404,14 @@ static inline void remove_from_ring(CondVar* cv, __cv_waiter* w)
   @see Cond_Broadcast
   */
 static int cv_wait(Mutex* mutex, CondVar* cv, 
-		enum SCHED_CAUSE cause, TimerDuration timeout)
+		enum SCHED_CAUSE cause, TimerDuration timeout, int killable)
 {
-	__cv_waiter waiter = { .thread=cur_thread(), .signalled = 0, .removed=0 };
+	__cv_waiter waiter = { .thread=cur_thread(), .signalled = 0, .removed=0, .morphed=0 };
 	rlnode_init(& waiter.node, &waiter);
 
+	if(killable)
+		set_wait_lock(waiter.thread, &(cv->waitset_lock));
+
 	Mutex_Lock(&(cv->waitset_lock));
 	/* We just push the current thread to the back of the list */
 	if(cv->waitset) {
@@ -133,11 +421,25 @@ static int cv_wait(Mutex* mutex, CondVar* cv,
 		cv->waitset = &waiter;
 	}
 
+	if(killable && is_killed(waiter.thread->owner_pcb)) {
+		/* Do not sleep, we still hold the mutex */
+		remove_from_ring(cv, &waiter);
+		Mutex_Unlock(&(cv->waitset_lock));
+		set_wait_lock(waiter.thread, NULL);
+		return 0;
+	}
+
 	/* Now atomically release mutex and sleep */
 	Mutex_Unlock(mutex);
 	sleep_releasing(STOPPED, &(cv->waitset_lock), cause, timeout);
 
-	/* Woke up, we must check wether we were signaled, and tidy up */
+	/* 
+		Woke up. We first re-lock the mutex, and only then tidy up, so that
+		if we are in a hand-off chain, the next waiter is woken after we own 
+		the mutex.
+	 */
+	Mutex_Lock(mutex);
+
 	Mutex_Lock(&(cv->waitset_lock));
 	if(! waiter.removed) {
 		assert(! waiter.signalled);
@@ -145,9 +447,18 @@ static int cv_wait(Mutex* mutex, CondVar* cv,
 		/* We must remove ourselves from the ring! */
 		remove_from_ring(cv, &waiter);
 	}
+	else if(waiter.morphed) {
+		/* Pass the baton to the next waiter of the chain, if any */
+		__cv_waiter* nextw = waiter.node.next->obj;
+		rlist_remove(& waiter.node);
+		if(nextw != &waiter)
+			wakeup(nextw->thread);
+	}
 	Mutex_Unlock(&(cv->waitset_lock));
 
-	Mutex_Lock(mutex);
+	if(killable)
+		set_wait_lock(waiter.thread, NULL);
+
 	return waiter.signalled;
 }
 
@@ -174,15 +485,63 @@ static inline void cv_signal(CondVar* cv)
 
 
 
+#if defined(LOCK_STATISTICS)
+/* 
+	Condition waits are accounted to the (mutex, caller) site. The time
+	blocked includes re-acquiring the mutex.
+ */
+static int cv_wait_stat(Mutex* mutex, CondVar* cv, 
+		enum SCHED_CAUSE cause, TimerDuration timeout, int killable, void* site)
+{
+	lockstat_rec* rec = lockstat_find(mutex, site);
+	uint64_t t0 = lockstat_now();
+	int ret = cv_wait(mutex, cv, cause, timeout, killable);
+	LOCKSTAT_ADD(rec, cond_waits, 1);
+	LOCKSTAT_ADD(rec, cond_ns, lockstat_now()-t0);
+	return ret;
+}
+#define cv_wait(mx, cv, cause, timeout, killable) \
+	cv_wait_stat((mx), (cv), (cause), (timeout), (killable), __builtin_return_address(0))
+#endif
+
+
+/*
+	A thread of a killed process, which waits in a user call, must not return
+	to a loop that waits again. It exits instead, releasing mx if not NULL.
+ */
+static void exit_killed_waiter(Mutex* mx)
+{
+	if(! is_killed(CURPROC)) return;
+	if(mx != NULL)
+		Mutex_Unlock(mx);
+	kernel_lock();
+	exit_if_killed();
+}
+
 int Cond_Wait(Mutex* mutex, CondVar* cv)
 {
-	return cv_wait(mutex, cv, SCHED_USER, NO_TIMEOUT);
+	int ret = cv_wait(mutex, cv, SCHED_USER, NO_TIMEOUT, 1);
+	exit_killed_waiter(mutex);
+	return ret;
 }
 
 int Cond_TimedWait(Mutex* mutex, CondVar* cv, timeout_t timeout)
 {
-	/* We have to translate timeout from msec to usec */
-	return cv_wait(mutex, cv, SCHED_USER, timeout*1000ul);
+	/* We have to translate timeout from msec to nsec */
+	return Cond_TimedWaitNs(mutex, cv, timeout*1000000ul);
+}
+
+int Cond_TimedWaitNs(Mutex* mutex, CondVar* cv, nsec_t timeout)
+{
+	int ret = cv_wait(mutex, cv, SCHED_USER, timeout, 1);
+	exit_killed_waiter(mutex);
+	return ret;
+}
+
+
+int spinlock_wait(Mutex* mutex, CondVar* cv, enum SCHED_CAUSE cause, TimerDuration timeout)
+{
+	return cv_wait(mutex, cv, cause, timeout, 1);
 }
 
 
@@ -194,10 +553,39 @@ void Cond_Signal(CondVar* cv)
 }
 
 
+/*
+	Broadcast with wait morphing.
+
+	Waking up all waiters at once would make them all contend for the
+	mutex they have to re-lock in cv_wait (a thundering herd). Since our 
+	Mutex has no wait queue of its own, we morph the whole waitset into a 
+	hand-off chain instead: all waiters are marked as signalled, but only the 
+	first one is woken up. Each waiter of the chain wakes up the next one,
+	after it has re-locked the mutex (see cv_wait). Therefore, the waiters
+	go through the mutex one at a time.
+
+	A waiter of the chain which wakes up for another reason (e.g., a 
+	timeout) still passes the baton when it gets the mutex, so the chain
+	is never broken.
+ */
 void Cond_Broadcast(CondVar* cv)
 {
   Mutex_Lock(&(cv->waitset_lock));
-  while(cv->waitset) cv_signal(cv);
+  __cv_waiter* head = cv->waitset;
+  if(head) {
+    cv->waitset = NULL;
+
+    rlnode* n = & head->node;
+    do {
+      __cv_waiter* w = n->obj;
+      w->removed = 1;
+      w->signalled = 1;
+      w->morphed = 1;
+      n = n->next;
+    } while(n != & head->node);
+
+    wakeup(head->thread);
+  }
   Mutex_Unlock(&(cv->waitset_lock));
 }
 
@@ -205,6 +593,236 @@ void Cond_Broadcast(CondVar* cv)
 
 
 
+/*
+	Barriers.
+	---------
+
+	Arrivals are counted by a combining tree: a thread adds 1 to the leaf of
+	its core, and then takes the whole count of the leaf, with an exchange. 
+	If the count is non-zero, it forwards it (add and exchange again) to the 
+	group node of the leaf, and then to the root. Every arrival is forwarded 
+	by the thread that added it or by a later one, so the root sees exactly
+	n arrivals per phase. Concurrent arrivals at a node are combined into a 
+	single forward.
+
+	The thread whose forward makes the root reach n completes the phase.
+	It resets the root, advances the epoch and then releases the parked 
+	threads, one leaf at a time.
+ */
+
+_Static_assert(BARRIER_LEAVES >= MAX_CORES, "BARRIER_LEAVES must be at least MAX_CORES");
+
+/** \cond HELPER Helper structure for barriers. */
+typedef struct __barrier_waiter {
+	struct __barrier_waiter* next;	/* the next waiter at the same leaf */
+	TCB* thread;					/* thread to wait */
+	unsigned int epoch;				/* the phase waited for */
+	sig_atomic_t released;			/* set when the thread is released */
+} __barrier_waiter;
+/** \endcond */
+
+#define BARRIER_SPINS (cpu_cores()>1 ? 200 : 0)
+
+/* Add k arrivals to a node and take back the node's pending count */
+static inline unsigned int barrier_combine(struct barrier_node* node, unsigned int k)
+{
+	__atomic_add_fetch(& node->count, k, __ATOMIC_ACQ_REL);
+	return __atomic_exchange_n(& node->count, 0, __ATOMIC_ACQ_REL);
+}
+
+/* 
+	Wake up all the threads parked at the barrier in phase epoch.
+
+	Threads released from the first leaves may arrive at the next phase
+	and park at a later leaf, before we get to it. These are left parked.
+ */
+static void barrier_release(Barrier* bar, unsigned int epoch)
+{
+	for(uint c=0; c<cpu_cores(); c++) {
+		struct barrier_node* leaf = & bar->leaf[c];
+		Mutex_Lock(& leaf->lock);
+		__barrier_waiter* w = leaf->waiters;
+		__barrier_waiter** keep = & leaf->waiters;
+		while(w) {
+			/* w may become invalid as soon as it is released */
+			__barrier_waiter* next = w->next;
+			if(w->epoch == epoch) {
+				/* 
+					Wake up first: once released is set, the waiter may return
+					and exit at any time (e.g., after a spurious wakeup), and 
+					its TCB may be gone.
+				 */
+				wakeup(w->thread);
+				__atomic_store_n(& w->released, 1, __ATOMIC_RELEASE);
+			} else {
+				*keep = w;
+				keep = & w->next;
+			}
+			w = next;
+		}
+		*keep = NULL;
+		Mutex_Unlock(& leaf->lock);
+	}
+}
+
+void Barrier_Init(Barrier* bar, unsigned int n)
+{
+	assert(n > 0);
+	memset(bar, 0, sizeof(Barrier));
+	bar->n = n;
+}
+
+int Barrier_Wait(Barrier* bar)
+{
+	unsigned int epoch = __atomic_load_n(& bar->epoch, __ATOMIC_ACQUIRE);
+	uint c = cpu_core_id;
+
+	/* Arrive */
+	unsigned int k = barrier_combine(& bar->leaf[c], 1);
+	if(k) k = barrier_combine(& bar->group[c / BARRIER_FANIN], k);
+	if(k && __atomic_add_fetch(& bar->arrived, k, __ATOMIC_ACQ_REL) == bar->n) {
+		/* We complete this phase */
+		__atomic_store_n(& bar->arrived, 0, __ATOMIC_RELAXED);
+		__atomic_add_fetch(& bar->epoch, 1, __ATOMIC_SEQ_CST);
+		barrier_release(bar, epoch);
+		return 1;
+	}
+
+	/* Spin for a while, in case the phase completes soon */
+	for(int spin = BARRIER_SPINS; spin > 0; spin--) {
+		if(__atomic_load_n(& bar->epoch, __ATOMIC_ACQUIRE) != epoch)
+			return 0;
+#if defined(__x86__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	/* Park at our leaf */
+	struct barrier_node* leaf = & bar->leaf[c];
+	__barrier_waiter waiter = { .next = NULL, .thread = cur_thread(), .epoch = epoch, .released = 0 };
+
+	Mutex_Lock(& leaf->lock);
+	if(__atomic_load_n(& bar->epoch, __ATOMIC_SEQ_CST) != epoch) {
+		Mutex_Unlock(& leaf->lock);
+		return 0;
+	}
+	waiter.next = leaf->waiters;
+	leaf->waiters = &waiter;
+	Mutex_Unlock(& leaf->lock);
+
+	/* 
+		The leaf lock is the lock of a killable wait (see kernel_interrupt).
+		We do not re-lock the leaf when we are released, since the releasing 
+		thread may still hold it. If we wake up before we are released, the
+		releaser holds the leaf lock until it has released us.
+	 */
+	set_wait_lock(waiter.thread, & leaf->lock);
+	while(! __atomic_load_n(& waiter.released, __ATOMIC_ACQUIRE)) {
+		Mutex_Lock(& leaf->lock);
+		if(waiter.released)
+			Mutex_Unlock(& leaf->lock);
+		else if(is_killed(CURPROC)) {
+			/* Leave the barrier; it is broken for the other waiters anyway */
+			__barrier_waiter** p = & leaf->waiters;
+			while(*p != &waiter) p = & (*p)->next;
+			*p = waiter.next;
+			Mutex_Unlock(& leaf->lock);
+			break;
+		}
+		else
+			sleep_releasing(STOPPED, & leaf->lock, SCHED_USER, NO_TIMEOUT);
+	}
+	set_wait_lock(waiter.thread, NULL);
+
+	exit_killed_waiter(NULL);
+	return 0;
+}
+
+#undef BARRIER_SPINS
+
+
+
+/*
+	Read-copy-update.
+	-----------------
+
+	This is a quiescent-state-based reclamation scheme. A global epoch counter
+	is advanced by each call to rcu_defer(), and the callback is tagged with the
+	new epoch. Each core records, at each quiescent state, the value of the 
+	global epoch it sees. A callback tagged with epoch E can be executed when 
+	every core has recorded a value at least E: each core has then passed a 
+	quiescent state after the object was unpublished.
+
+	Readers do not write any shared memory; quiescent states are recorded 
+	only at context switches.
+
+	Each core keeps its own list of callbacks, in increasing epoch order, and 
+	executes them itself. Thus, the callbacks of an idle (halted) core are not
+	executed until the core wakes up again, at the latest at its next timer 
+	interrupt, even if the grace period has expired long before.
+ */
+
+#define RCU_IDLE  ((uint64_t)-1)
+
+static uint64_t rcu_epoch = 1;
+
+void rcu_defer(rcu_callback* cb, void (*func)(void*), void* obj)
+{
+	int preempt = preempt_off;
+	CCB* ccb = & cctx[cpu_core_id];
+
+	rlnode_init(& cb->node, obj);
+	cb->func = func;
+	cb->epoch = __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+	rlist_push_back(& ccb->rcu_deferred, & cb->node);
+
+	if(preempt) preempt_on;
+}
+
+/* Return the minimum epoch seen by all cores */
+static uint64_t rcu_grace_epoch()
+{
+	uint64_t min = RCU_IDLE;
+	for(uint c=0; c<cpu_cores(); c++) {
+		uint64_t qs = __atomic_load_n(& cctx[c].rcu_qs, __ATOMIC_SEQ_CST);
+		if(qs < min) min = qs;
+	}
+	return min;
+}
+
+/* Execute the callbacks in list, with epoch up to limit */
+static void rcu_run_callbacks(rlnode* list, uint64_t limit)
+{
+	while(! is_rlist_empty(list)) {
+		rcu_callback* cb = (rcu_callback*) list->next;
+		if(cb->epoch > limit) break;
+		rlist_pop_front(list);
+		cb->func(cb->node.obj);
+	}
+}
+
+void rcu_quiescent()
+{
+	CCB* ccb = & cctx[cpu_core_id];
+	__atomic_store_n(& ccb->rcu_qs, __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST), 
+		__ATOMIC_SEQ_CST);
+
+	if(! is_rlist_empty(& ccb->rcu_deferred))
+		rcu_run_callbacks(& ccb->rcu_deferred, rcu_grace_epoch());
+}
+
+void rcu_idle()
+{
+	__atomic_store_n(& cctx[cpu_core_id].rcu_qs, RCU_IDLE, __ATOMIC_SEQ_CST);
+}
+
+void rcu_flush()
+{
+	rcu_run_callbacks(& cctx[cpu_core_id].rcu_deferred, RCU_IDLE);
+}
+
+
+
 /*
  *
  * The kernel locks
@@ -235,7 +853,7 @@ void kernel_lock()
 {
 	Mutex_Lock(& kernel_mutex);
 	while(kernel_sem<=0) {
-		Cond_Wait(& kernel_mutex, &kernel_sem_cv);
+		cv_wait(& kernel_mutex, &kernel_sem_cv, SCHED_USER, NO_TIMEOUT, 0);
 	}
 	kernel_sem--;
 	Mutex_Unlock(& kernel_mutex);
@@ -252,22 +870,45 @@ void kernel_unlock()
 int kernel_wait_wchan(CondVar* cv, enum SCHED_CAUSE cause, 
 	const char* wchan_name, TimerDuration timeout)
 {
+	/* A killed process does not block any more */
+	if(is_killed(CURPROC))
+		return 0;
+
 	/* Atomically release kernel semaphore */
 	Mutex_Lock(& kernel_mutex);
 	kernel_sem++;
 	Cond_Signal(&kernel_sem_cv);	
 
-	int ret = cv_wait(&kernel_mutex, cv, cause, timeout);
+	int ret = cv_wait(&kernel_mutex, cv, cause, timeout, 1);
 
 	/* Reacquire kernel semaphore */
 	while(kernel_sem<=0)
-		Cond_Wait(& kernel_mutex, &kernel_sem_cv);
+		cv_wait(& kernel_mutex, &kernel_sem_cv, SCHED_USER, NO_TIMEOUT, 0);
 	kernel_sem--;
 	Mutex_Unlock(& kernel_mutex);		
 
 	return ret;
 }
 
+/*
+	A killable wait checks is_killed while it holds the lock it releases 
+	when it sleeps, and publishes that lock in tcb->wait_lock. We take the
+	same lock before the wakeup, so the thread either sees that it was killed, 
+	or it is already asleep when we wake it up.
+ */
+void kernel_interrupt(TCB* tcb)
+{
+	/* The lock may be taken by an interrupt handler (e.g., serial_rx_handler) */
+	int pre = preempt_off;
+	Mutex_Lock(& tcb->wait_guard);
+	Mutex* mx = tcb->wait_lock;
+	if(mx != NULL) Mutex_Lock(mx);
+	wakeup(tcb);
+	if(mx != NULL) Mutex_Unlock(mx);
+	Mutex_Unlock(& tcb->wait_guard);
+	if(pre) preempt_on;
+}
+
 void kernel_signal(CondVar* cv) 
 { 
 	Cond_Signal(cv); 
@@ -49,6 +49,11 @@ void kernel_unlock();
 
 /**
 	@brief Wait on a condition variable using the kernel lock.
+
+	The timeout is in nanoseconds, or @c NO_TIMEOUT.
+
+	If the process of the caller has been killed, this returns 0 at once. 
+	Therefore, callers that wait in a loop must also check @c is_killed.
 	@returns 1 if signalled, 0 if not
   */
 int kernel_wait_wchan(CondVar* cv, enum SCHED_CAUSE cause, 
@@ -59,6 +64,35 @@ int kernel_wait_wchan(CondVar* cv, enum SCHED_CAUSE cause,
 #define kernel_timedwait(cv, cause, timeout) \
 	kernel_wait_wchan((cv),(cause),__FUNCTION__, (timeout))
 
+/**
+	@brief Wait on a condition variable, releasing a mutex.
+
+	This is used by kernel code that runs without the kernel lock (e.g., 
+	device drivers called by unlocked system calls), to wait while holding 
+	a spinlock of its own. It is like @c Cond_TimedWaitNs, but it takes a 
+	scheduler cause.
+
+	Like @c kernel_wait, it returns 0 at once if the process of the caller 
+	has been killed, so callers that wait in a loop must check @c is_killed.
+
+	@returns 1 if signalled, 0 if not
+  */
+int spinlock_wait(Mutex* mx, CondVar* cv, enum SCHED_CAUSE cause, TimerDuration timeout);
+
+/**
+	@brief Wake up a thread blocked in the kernel.
+
+	A thread blocked in a killable wait (@c kernel_wait, @c spinlock_wait, 
+	@c Cond_Wait or @c Barrier_Wait) returns from it as if its timeout had
+	expired; the user calls then exit the thread. Any other stopped thread 
+	(e.g., in @c Sleep) is woken up, and it sees a spurious wakeup. This must 
+	be called with the kernel lock held, after the process has been marked 
+	as killed.
+
+	@see KillGroup
+  */
+void kernel_interrupt(TCB* tcb);
+
 /**
 	@brief Signal a kernel condition to one waiter.
 
@@ -82,6 +116,116 @@ void kernel_sleep(Thread_state state, enum SCHED_CAUSE cause);
 
 
 
+/**
+	@brief Print the lock statistics.
+
+	This is only available when the kernel is compiled with @c LOCK_STATISTICS
+	defined. It prints to @c stderr a table with one line per lock site
+	(mutex address and code address of the locking call), sorted by 
+	total waiting time.
+
+	@see lock_statistics_reset
+  */
+void lock_statistics_report();
+
+/**
+	@brief Clear the lock statistics.
+
+	This is only available when the kernel is compiled with @c LOCK_STATISTICS
+	defined.
+  */
+void lock_statistics_reset();
+
+
+/*
+ * Read-copy-update
+ */
+
+/**
+	@brief A deferred RCU callback.
+
+	Objects that are reclaimed via RCU embed one of these. 
+	@see rcu_defer
+ */
+typedef struct rcu_callback {
+	rlnode node;				/**< @brief Intrusive node, its key is the object */
+	uint64_t epoch;				/**< @brief The epoch this callback waits for */
+	void (*func)(void* obj);	/**< @brief The function to call */
+} rcu_callback;
+
+
+/**
+	@brief Enter an RCU read-side section.
+
+	Inside a read-side section, objects published by other cores can be read
+	without locks, and they will not be reclaimed until the section ends,
+	even if they are unpublished concurrently. 
+
+	A read-side section disables preemption, so it must be short and it must not
+	block (e.g., it must not call @c kernel_wait or @c yield).  
+
+	A typical read-side section is
+	@code
+	int rcu = rcu_read_lock();
+	...  // read shared objects
+	rcu_read_unlock(rcu);
+	@endcode
+
+	@returns the preemption status, to pass to @c rcu_read_unlock
+ */
+static inline int rcu_read_lock() { return cpu_disable_interrupts(); }
+
+/**
+	@brief Leave an RCU read-side section.
+
+	@param preempt the value returned by the matching @c rcu_read_lock
+ */
+static inline void rcu_read_unlock(int preempt) { if(preempt) cpu_enable_interrupts(); }
+
+/**
+	@brief Defer a call until all current read-side sections have ended.
+
+	After an object has been unpublished (i.e., it is not reachable by new readers),
+	this call arranges for @c func(obj) to be called, after every core has passed
+	through a quiescent state. Quiescent states are context switches (see @c gain()) 
+	and idleness, therefore no read-side section that may have seen the object
+	is active at that time.
+
+	The callback is executed with preemption off, and must not block.
+	It is executed by the calling core, at one of its context switches; if the 
+	core goes idle, the callback waits until the core wakes up again.
+
+	@param cb the callback record, which must remain valid until the call
+	@param func the function to call
+	@param obj the argument to @c func
+ */
+void rcu_defer(rcu_callback* cb, void (*func)(void*), void* obj);
+
+/**
+	@brief Report a quiescent state for the current core.
+
+	This is called by the scheduler, with preemption off, at every context switch.
+	It also executes the callbacks of this core whose grace period has expired.
+ */
+void rcu_quiescent();
+
+/**
+	@brief Report that the current core is going idle.
+
+	An idle core holds no references, so it does not hold back grace periods.
+	The core is considered active again at its next @c rcu_quiescent.
+ */
+void rcu_idle();
+
+/**
+	@brief Execute all deferred callbacks of the current core.
+
+	This is only safe when no read-side sections can be active anywhere, e.g.,
+	at scheduler shutdown.
+ */
+void rcu_flush();
+
+
 /** @brief Set the preemption status for the current core.
 
  	Preemption is disabled by disabling interrupts. 
@@ -15,6 +15,62 @@
 DCB DT[MAX_TERMINALS];
 
 
+/* ===================================
+
+  Wait queues for Poll
+
+  ====================================*/
+
+void wait_queue_init(wait_queue* wq)
+{
+  wq->lock = MUTEX_INIT;
+  rlnode_init(& wq->entries, NULL);
+}
+
+void wait_queue_add(wait_queue* wq, poll_entry* pe)
+{
+  assert(pe->queue == NULL);
+  int pre = preempt_off;
+  Mutex_Lock(& wq->lock);
+  rlist_push_back(& wq->entries, rlnode_init(& pe->node, pe));
+  pe->queue = wq;
+  Mutex_Unlock(& wq->lock);
+  if(pre) preempt_on;
+}
+
+void wait_queue_remove(poll_entry* pe)
+{
+  wait_queue* wq = pe->queue;
+  if(wq == NULL) return;
+  int pre = preempt_off;
+  Mutex_Lock(& wq->lock);
+  rlist_remove(& pe->node);
+  pe->queue = NULL;
+  Mutex_Unlock(& wq->lock);
+  if(pre) preempt_on;
+}
+
+void wait_queue_wakeup(wait_queue* wq)
+{
+  int pre = preempt_off;
+  Mutex_Lock(& wq->lock);
+  for(rlnode* n = wq->entries.next; n != & wq->entries; n = n->next) {
+    poll_entry* pe = n->obj;
+    if(pe->wake) {
+      pe->wake(pe);
+      continue;
+    }
+    poll_waiter* w = pe->waiter;
+    Mutex_Lock(& w->lock);
+    w->woken = 1;
+    Cond_Broadcast(& w->wake);
+    Mutex_Unlock(& w->lock);
+  }
+  Mutex_Unlock(& wq->lock);
+  if(pre) preempt_on;
+}
+
+
 /* ===================================
 
   The null device driver
@@ -37,6 +93,25 @@ int nulldev_write(void* dev, const char* buf, unsigned int size)
 }
 
 
+int nulldev_readv(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  int total = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    memset(iov[i].base, 0, iov[i].len);
+    total += iov[i].len;
+  }
+  return total;
+}
+
+int nulldev_writev(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  int total = 0;
+  for(unsigned int i=0; i<iovcnt; i++)
+    total += iov[i].len;
+  return total;
+}
+
+
 int nulldev_close(void* dev) 
 {
   return 0;
@@ -47,11 +122,20 @@ void* nulldev_open(uint minor)
   return NULL;
 }
 
+int nulldev_poll(void* dev, poll_entry* pe)
+{
+  /* Always ready, so there is no need to register */
+  return POLL_READ | POLL_WRITE;
+}
+
 static file_ops nulldev_fops = {
   .Open = nulldev_open,
   .Read = nulldev_read,
   .Write = nulldev_write,
-  .Close = nulldev_close
+  .Close = nulldev_close,
+  .ReadV = nulldev_readv,
+  .WriteV = nulldev_writev,
+  .Poll = nulldev_poll
 };
 
 
@@ -68,8 +152,12 @@ void serial_tx_handler();
 
 typedef struct serial_device_control_block {
   uint devno;
-  Mutex spinlock;
+  Mutex spinlock;     /* serializes readers and protects rx_ready and the lookahead */
   CondVar rx_ready;
+  Mutex tx_lock;      /* serializes writers */
+  wait_queue pollers; /* woken up with rx_ready */
+  int has_lookahead;  /* set if lookahead holds a byte read by serial_poll */
+  char lookahead;
 } serial_dcb_t;
 
 serial_dcb_t serial_dcb[MAX_TERMINALS];
@@ -90,38 +178,91 @@ void serial_rx_handler()
    */
   for(int i=0;i<bios_serial_ports();i++) {
     serial_dcb_t* dcb = &serial_dcb[i];
+    Mutex_Lock(&dcb->spinlock);
     Cond_Broadcast(&dcb->rx_ready);
+    wait_queue_wakeup(&dcb->pollers);
+    Mutex_Unlock(&dcb->spinlock);
   }
   if(pre) preempt_on;
 }
 
 /*
   Read from the device, sleeping if needed.
+
+  This is called without the kernel lock. The rx_handler broadcasts 
+  rx_ready while holding the spinlock, so a wakeup cannot be lost 
+  between a failed read and the wait.
+
+  The thread sleeps only while no byte has been read; the buffers
+  are filled in order, as long as bytes are available. If nonblock is 
+  set, the thread does not sleep, and STREAM_WOULDBLOCK is returned
+  instead.
  */
-int serial_read(void* dev, char *buf, unsigned int size)
+static int serial_read_iov(serial_dcb_t* dcb, const iovec_t* iov, unsigned int iovcnt, int nonblock)
 {
-  serial_dcb_t* dcb = (serial_dcb_t*)dev;
-
-  preempt_off;            /* Stop preemption */
+  int pre = preempt_off;            /* Stop preemption */
+  Mutex_Lock(&dcb->spinlock);
 
   uint count =  0;
-
-  while(count<size) {
-    int valid = bios_read_serial(dcb->devno, &buf[count]);
+  int blocked = 0;
+  int killed = 0;
+
+  for(unsigned int i=0; i<iovcnt; i++) {
+    char* buf = iov[i].base;
+    uint size = iov[i].len;
+    uint n = 0;
+
+    while(n<size) {
+      /* 
+        A byte read ahead by serial_poll comes first. A poller may run 
+        while we wait, so this is checked before every read.
+       */
+      int valid;
+      if(dcb->has_lookahead) {
+        buf[n] = dcb->lookahead;
+        dcb->has_lookahead = 0;
+        valid = 1;
+      }
+      else
+        valid = bios_read_serial(dcb->devno, &buf[n]);
     
-    if (valid) {
-      count++;
-    }
-    else if(count==0) {
-      kernel_wait(&dcb->rx_ready, SCHED_IO);
+      if (valid) {
+        n++;
+      }
+      else if(count+n==0 && !nonblock && !(killed = is_killed(CURPROC))) {
+        spinlock_wait(&dcb->spinlock, &dcb->rx_ready, SCHED_IO, NO_TIMEOUT);
+      }
+      else {
+        blocked = (count+n==0);
+        break;
+      }
     }
-    else
-      break;
+
+    count += n;
+    if(n < size) break;
   }
 
-  preempt_on;           /* Restart preemption */
+  Mutex_Unlock(&dcb->spinlock);
+  if(pre) preempt_on;           /* Restart preemption */
+
+  if(killed) return -1;
+  return blocked ? STREAM_WOULDBLOCK : (int) count;
+}
+
+int serial_readv(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  return serial_read_iov((serial_dcb_t*)dev, iov, iovcnt, 0);
+}
+
+int serial_tryreadv(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  return serial_read_iov((serial_dcb_t*)dev, iov, iovcnt, 1);
+}
 
-  return count;
+int serial_read(void* dev, char *buf, unsigned int size)
+{
+  iovec_t iov = { buf, size };
+  return serial_readv(dev, &iov, 1);
 }
 
 
@@ -137,28 +278,58 @@ void serial_tx_handler()
 
 /* 
   Write call 
-  This is currently a polling driver.
+  This is currently a polling driver. The buffers of one call are written
+  contiguously. If nonblock is set and the first byte cannot be sent, 
+  return STREAM_WOULDBLOCK instead of yielding.
 */
-int serial_write(void* dev, const char* buf, unsigned int size)
+static int serial_write_iov(serial_dcb_t* dcb, const iovec_t* iov, unsigned int iovcnt, int nonblock)
 {
-  serial_dcb_t* dcb = (serial_dcb_t*)dev;
+  /* Keep each write contiguous */
+  Mutex_Lock(&dcb->tx_lock);
 
   unsigned int count = 0;
-  while(count < size) {
-    int success = bios_write_serial(dcb->devno, buf[count] );
-
-    if(success) {
-      count++;
-    } 
-    else if(count==0)
-    {
-      yield(SCHED_IO);
+  int blocked = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    const char* buf = iov[i].base;
+    unsigned int n = 0;
+    while(n < iov[i].len) {
+      int success = bios_write_serial(dcb->devno, buf[n] );
+
+      if(success) {
+        n++;
+      } 
+      else if(count+n==0 && !nonblock)
+      {
+        yield(SCHED_IO);
+      }
+      else {
+        blocked = (count+n==0);
+        break;
+      }
     }
-    else
-      break;
+
+    count += n;
+    if(n < iov[i].len) break;
   }
 
-  return count;  
+  Mutex_Unlock(&dcb->tx_lock);
+  return blocked ? STREAM_WOULDBLOCK : (int) count;  
+}
+
+int serial_writev(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  return serial_write_iov((serial_dcb_t*)dev, iov, iovcnt, 0);
+}
+
+int serial_trywritev(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  return serial_write_iov((serial_dcb_t*)dev, iov, iovcnt, 1);
+}
+
+int serial_write(void* dev, const char* buf, unsigned int size)
+{
+  iovec_t iov = { (void*) buf, size };
+  return serial_writev(dev, &iov, 1);
 }
 
 
@@ -175,12 +346,42 @@ void* serial_open(uint term)
 }
 
 
+/*
+  The device cannot be asked if a byte is available without reading it, 
+  so a byte is read ahead and kept for the next serial_read. 
+  Writes are always considered possible, since the device accepts bytes
+  at a steady rate.
+ */
+int serial_poll(void* dev, poll_entry* pe)
+{
+  serial_dcb_t* dcb = (serial_dcb_t*)dev;
+
+  int pre = preempt_off;
+  Mutex_Lock(&dcb->spinlock);
+
+  if(pe) wait_queue_add(&dcb->pollers, pe);
+  if(! dcb->has_lookahead)
+    dcb->has_lookahead = bios_read_serial(dcb->devno, &dcb->lookahead);
+  int events = POLL_WRITE | (dcb->has_lookahead ? POLL_READ : 0);
+
+  Mutex_Unlock(&dcb->spinlock);
+  if(pre) preempt_on;
+
+  return events;
+}
+
+
 
 file_ops serial_fops = {
   .Open = serial_open,
   .Read = serial_read,
   .Write = serial_write,
-  .Close = serial_close
+  .Close = serial_close,
+  .ReadV = serial_readv,
+  .WriteV = serial_writev,
+  .TryReadV = serial_tryreadv,
+  .TryWriteV = serial_trywritev,
+  .Poll = serial_poll
 };
 
 
@@ -211,6 +412,9 @@ void initialize_devices()
     serial_dcb[i].devno = i;
     serial_dcb[i].rx_ready = COND_INIT;
     serial_dcb[i].spinlock = MUTEX_INIT;
+    serial_dcb[i].tx_lock = MUTEX_INIT;
+    wait_queue_init(&serial_dcb[i].pollers);
+    serial_dcb[i].has_lookahead = 0;
   }
 
   cpu_interrupt_handler(SERIAL_RX_READY, serial_rx_handler);
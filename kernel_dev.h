@@ -9,6 +9,7 @@
 
 #include "util.h"
 #include "bios.h"
+#include "tinyos.h"
 
 /**
   @file kernel_dev.h
@@ -34,6 +35,67 @@
 */
 
 
+/**
+  @brief A thread waiting for events on many streams.
+
+  @see Poll
+ */
+typedef struct poll_waiter {
+  Mutex lock;       /**< @brief A spinlock protecting @c woken */
+  CondVar wake;     /**< @brief Signalled when @c woken is set */
+  int woken;        /**< @brief Set when some stream may have become ready */
+} poll_waiter;
+
+/**
+  @brief A list of poll waiters, kept by a stream.
+
+  A stream whose readiness changes asynchronously keeps one of these, and
+  wakes up its waiters by @c wait_queue_wakeup when it may have become ready.
+ */
+typedef struct wait_queue {
+  Mutex lock;       /**< @brief A spinlock protecting @c entries */
+  rlnode entries;   /**< @brief The list of @c poll_entry */
+} wait_queue;
+
+/**
+  @brief A registration of a poll waiter at a wait queue.
+ */
+typedef struct poll_entry {
+  poll_waiter* waiter;    /**< @brief The waiter */
+  wait_queue* queue;      /**< @brief The queue, or NULL if not registered */
+  rlnode node;            /**< @brief Intrusive node for @c queue->entries */
+
+  /** @brief Called by @c wait_queue_wakeup instead of waking up @c waiter, if not NULL.
+
+    It is called with the queue locked, possibly by an interrupt handler.
+    @see EpollCreate
+   */
+  void (*wake)(struct poll_entry* pe);
+} poll_entry;
+
+/** @brief Initialize a wait queue. */
+void wait_queue_init(wait_queue* wq);
+
+/** 
+  @brief Register a poll entry at a wait queue.
+
+  This is called by the @c Poll method of a stream, with the entry it was 
+  given. The entry is removed by the caller of the method.
+ */
+void wait_queue_add(wait_queue* wq, poll_entry* pe);
+
+/** @brief Remove a poll entry from its wait queue, if any. */
+void wait_queue_remove(poll_entry* pe);
+
+/** 
+  @brief Wake up all the waiters of a wait queue.
+
+  This can be called by interrupt handlers. For entries with a @c wake 
+  function, the function is called instead.
+ */
+void wait_queue_wakeup(wait_queue* wq);
+
+
 /**
   @brief The device-specific file operations table.
 
@@ -92,6 +154,51 @@ typedef struct file_operations {
     - There was a I/O runtime problem.
      */
     int (*Close)(void* this);
+
+    /** @brief Vectored read operation.
+
+      Read into the buffers of @c iov in order, like @c Read. This method is optional;
+      if it is NULL, @c ReadV calls @c Read for each buffer.
+     */
+    int (*ReadV)(void* this, const iovec_t* iov, unsigned int iovcnt);
+
+    /** @brief Vectored write operation.
+
+      Write the buffers of @c iov in order, like @c Write. This method is optional;
+      if it is NULL, @c WriteV calls @c Write for each buffer.
+     */
+    int (*WriteV)(void* this, const iovec_t* iov, unsigned int iovcnt);
+
+    /** @brief Non-blocking vectored read operation.
+
+      Like @c ReadV, but if no data is available at once, return @c STREAM_WOULDBLOCK
+      instead of blocking. This method is optional; it is used for streams with
+      the @c STREAM_NONBLOCK flag, and if it is NULL, the stream is polled
+      before it is read.
+     */
+    int (*TryReadV)(void* this, const iovec_t* iov, unsigned int iovcnt);
+
+    /** @brief Non-blocking vectored write operation.
+
+      Like @c WriteV, but if not even one byte can be written at once, return 
+      @c STREAM_WOULDBLOCK instead of blocking. This method is optional; it is 
+      used for streams with the @c STREAM_NONBLOCK flag, and if it is NULL, the 
+      stream is polled before it is written.
+     */
+    int (*TryWriteV)(void* this, const iovec_t* iov, unsigned int iovcnt);
+
+    /** @brief Poll operation.
+
+      Return the events of the stream that are ready, among @c POLL_READ, @c POLL_WRITE,
+      @c POLL_ERROR and @c POLL_HANGUP. If @c pe is not NULL, it must be registered at a 
+      wait queue of the stream (see @c wait_queue_add) which is woken up
+      when the readiness of the stream may have changed. In order not to lose 
+      wakeups, the entry must be registered before readiness is checked.
+
+      This is called without the kernel lock. If this method is NULL, 
+      the stream is always ready for reading and writing.
+     */
+    int (*Poll)(void* this, poll_entry* pe);
 } file_ops;
 
 
@@ -9,6 +9,7 @@
 #include "kernel_proc.h"
 #include "kernel_dev.h"
 #include "kernel_streams.h"
+#include "kernel_cc.h"
 
 
 
@@ -66,6 +67,13 @@ void boot(uint ncores, uint nterm, Task boot_task, int argl, void* args)
   boot_rec.args = args;
 
   vm_boot(boot_tinyos_kernel, ncores, nterm);
+
+  finalize_processes();
+
+#if defined(LOCK_STATISTICS)
+  lock_statistics_report();
+  lock_statistics_reset();
+#endif
 }
 
 
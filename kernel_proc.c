@@ -1,5 +1,6 @@
 
 #include <assert.h>
+#include <stddef.h>
 #include "kernel_cc.h"
 #include "kernel_proc.h"
 #include "kernel_streams.h"
@@ -16,30 +17,64 @@
 
  */
 
-/* The process table */
-PCB PT[MAX_PROC];
+/* 
+  The process table.
+
+  The PCBs are allocated in chunks of PT_CHUNK, on demand. The chunk
+  directory is static, so that the PCB of a PID is found in O(1) without
+  locks. Chunks are never freed while the kernel runs, so a PCB pointer
+  remains valid (although the PCB may be recycled, see release_PCB).
+
+  Free PCBs are kept in a FIFO list, so that a released PID is reused
+  as late as possible. In addition, a new chunk is allocated when the
+  free list becomes shorter than PID_REUSE_MIN. Therefore, as long as
+  the table can grow, a PID is not reused before at least PID_REUSE_MIN
+  other processes have been created.
+ */
+#define PT_CHUNK_BITS 8
+#define PT_CHUNK (1 << PT_CHUNK_BITS)
+#define PT_CHUNKS (MAX_PROC / PT_CHUNK)
+#define PID_REUSE_MIN (PT_CHUNK/4)
+
+static PCB* PT[PT_CHUNKS];
+static unsigned int pt_chunks;
 unsigned int process_count;
 
 PCB* get_pcb(Pid_t pid)
 {
-  return PT[pid].pstate==FREE ? NULL : &PT[pid];
+  if(pid < 0 || pid >= MAX_PROC) return NULL;
+  PCB* chunk = __atomic_load_n(&PT[pid >> PT_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  if(chunk == NULL) return NULL;
+  PCB* pcb = &chunk[pid & (PT_CHUNK-1)];
+  return __atomic_load_n(&pcb->pstate, __ATOMIC_ACQUIRE)==FREE ? NULL : pcb;
+}
+
+/* Return the PCB of a pid, even if it is free */
+static PCB* get_pcb_slot(Pid_t pid)
+{
+  if(pid < 0 || pid >= MAX_PROC) return NULL;
+  PCB* chunk = __atomic_load_n(&PT[pid >> PT_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  return (chunk == NULL) ? NULL : &chunk[pid & (PT_CHUNK-1)];
 }
 
 Pid_t get_pid(PCB* pcb)
 {
-  return pcb==NULL ? NOPROC : pcb-PT;
+  return pcb==NULL ? NOPROC : pcb->pid;
 }
 
 /* Initialize a PCB */
-static inline void initialize_PCB(PCB* pcb)
+static inline void initialize_PCB(PCB* pcb, Pid_t pid)
 {
+  pcb->pid = pid;
   pcb->pstate = FREE;
   pcb->argl = 0;
   pcb->args = NULL;
   pcb->thread_count=0;
+  pcb->thread_table = NULL;
+  pcb->thread_table_size = 0;
+  pcb->thread_free = -1;
 
-  for(int i=0;i<MAX_FILEID;i++)
-    pcb->FIDT[i] = NULL;
+  pcb->FIDT = NULL;
 
   rlnode_init(& pcb->children_list, NULL);
   rlnode_init(& pcb->exited_list, NULL);
@@ -47,27 +82,65 @@ static inline void initialize_PCB(PCB* pcb)
   rlnode_init(& pcb->children_node, pcb);
   rlnode_init(& pcb->exited_node, pcb);
   pcb->child_exit = COND_INIT;
+  pcb->exit_wait = COND_INIT;
+  pcb->waited = 0;
+
+  pcb->pgid = NOPROC;
+  rlnode_init(& pcb->group_node, pcb);
+  rlnode_init(& pcb->group_members, NULL);
+  pcb->group_change = COND_INIT;
+  pcb->group_held = 0;
+  pcb->killed = 0;
+  pcb->kill_status = 0;
 }
 
 
+/* The free list is a FIFO, linked via the parent field */
 static PCB* pcb_freelist;
+static PCB* pcb_freelist_tail;
+static unsigned int pcb_free_count;
+static Mutex pcb_freelist_lock = MUTEX_INIT;
 
-void initialize_processes()
+static void pcb_freelist_append(PCB* pcb)
 {
-  /* initialize the PCBs */
-  for(Pid_t p=0; p<MAX_PROC; p++) {
-    initialize_PCB(&PT[p]);
-  }
+  pcb->parent = NULL;
+  if(pcb_freelist == NULL)
+    pcb_freelist = pcb;
+  else
+    pcb_freelist_tail->parent = pcb;
+  pcb_freelist_tail = pcb;
+  pcb_free_count++;
+}
+
+/* 
+  Allocate a new chunk and append its PCBs to the free list. 
+  Must be called with pcb_freelist_lock held. 
+*/
+static void grow_process_table()
+{
+  if(pt_chunks == PT_CHUNKS) return;
 
-  /* use the parent field to build a free list */
-  PCB* pcbiter;
-  pcb_freelist = NULL;
-  for(pcbiter = PT+MAX_PROC; pcbiter!=PT; ) {
-    --pcbiter;
-    pcbiter->parent = pcb_freelist;
-    pcb_freelist = pcbiter;
+  PCB* chunk = xmalloc(PT_CHUNK * sizeof(PCB));
+  Pid_t base = pt_chunks * PT_CHUNK;
+  for(Pid_t p=0; p<PT_CHUNK; p++) {
+    initialize_PCB(&chunk[p], base+p);
+    pcb_freelist_append(&chunk[p]);
   }
 
+  /* Publish the chunk to get_pcb() */
+  __atomic_store_n(&PT[pt_chunks], chunk, __ATOMIC_RELEASE);
+  pt_chunks++;
+}
+
+
+void initialize_processes()
+{
+  for(unsigned int c=0; c<PT_CHUNKS; c++)
+    PT[c] = NULL;
+  pt_chunks = 0;
+
+  pcb_freelist = pcb_freelist_tail = NULL;
+  pcb_free_count = 0;
   process_count = 0;
 
   /* Execute a null "idle" process */
@@ -77,31 +150,149 @@ void initialize_processes()
 
 
 /*
+  Free the memory still held by a PCB after the VM has halted. Exiting 
+  processes release it themselves, but e.g. the idle process never exits.
+  There are no concurrent readers any more, so nothing is deferred.
+*/
+static void cleanup_PCB(PCB* pcb)
+{
+  release_args(pcb->args);
+  pcb->args = NULL;
+  release_thread_table(pcb);
+  free(pcb->FIDT);
+  pcb->FIDT = NULL;
+}
+
+void finalize_processes()
+{
+  for(unsigned int c=0; c<pt_chunks; c++) {
+    for(Pid_t p=0; p<PT_CHUNK; p++)
+      cleanup_PCB(&PT[c][p]);
+    free(PT[c]);
+    PT[c] = NULL;
+  }
+  pt_chunks = 0;
+  pcb_freelist = pcb_freelist_tail = NULL;
+  pcb_free_count = 0;
+}
+
+
+/*
+  Acquire up to num PCBs, holding the free list lock once.
+  Return the number of PCBs acquired.
+
   Must be called with kernel_mutex held
 */
+static unsigned int acquire_PCBs(unsigned int num, PCB** pcbs)
+{
+  unsigned int got = 0;
+
+  Mutex_Lock(&pcb_freelist_lock);
+  while(got < num) {
+    if(pcb_free_count < PID_REUSE_MIN)
+      grow_process_table();
+    if(pcb_freelist == NULL) break;
+    pcbs[got++] = pcb_freelist;
+    pcb_freelist = pcb_freelist->parent;
+    pcb_free_count--;
+  }
+  Mutex_Unlock(&pcb_freelist_lock);
+
+  for(unsigned int i=0; i<got; i++) {
+    memset(& pcbs[i]->usage, 0, sizeof(proc_usage));
+    pcbs[i]->heap = 0;
+    pcbs[i]->killed = 0;
+    pcbs[i]->tls_used = 0;
+    __atomic_store_n(&pcbs[i]->pstate, ALIVE, __ATOMIC_RELEASE);
+  }
+  process_count += got;
+
+  return got;
+}
+
 PCB* acquire_PCB()
 {
-  PCB* pcb = NULL;
+  PCB* pcb;
+  return acquire_PCBs(1, &pcb) ? pcb : NULL;
+}
+
+/* RCU callback: return a PCB to the free list */
+static void recycle_PCB(void* obj)
+{
+  PCB* pcb = obj;
+  Mutex_Lock(&pcb_freelist_lock);
+  pcb_freelist_append(pcb);
+  Mutex_Unlock(&pcb_freelist_lock);
+}
 
-  if(pcb_freelist != NULL) {
-    pcb = pcb_freelist;
-    pcb->pstate = ALIVE;
-    pcb_freelist = pcb_freelist->parent;
-    process_count++;
+/*
+ *
+ * Process groups
+ *
+ */
+
+/*
+  The members of a process group are kept in the group_members list of the
+  PCB whose pid is the pgid. That PCB may belong to a process outside the group,
+  or to no process at all, since the group exists as long as it has members.
+  Therefore, a released PCB is not recycled while its group_members list is 
+  not empty (see release_PCB).
+
+  A process remains a member of its group until it is reaped.
+  All of this is protected by the kernel lock.
+ */
+
+/* Return the PCB anchoring the group pgid, or NULL if there is no such group */
+static PCB* find_group(Pid_t pgid)
+{
+  PCB* g = get_pcb_slot(pgid);
+  return (g == NULL || is_rlist_empty(& g->group_members)) ? NULL : g;
+}
+
+static void join_group(PCB* pcb, Pid_t pgid)
+{
+  pcb->pgid = pgid;
+  rlist_push_back(& get_pcb_slot(pgid)->group_members, & pcb->group_node);
+}
+
+static void leave_group(PCB* pcb)
+{
+  PCB* g = get_pcb_slot(pcb->pgid);
+  rlist_remove(& pcb->group_node);
+  pcb->pgid = NOPROC;
+
+  if(is_rlist_empty(& g->group_members)) {
+    kernel_broadcast(& g->group_change);
+    if(g->group_held) {
+      g->group_held = 0;
+      rcu_defer(&g->rcu, recycle_PCB, g);
+    }
   }
+}
 
-  return pcb;
+void signal_group(PCB* pcb)
+{
+  kernel_broadcast(& get_pcb_slot(pcb->pgid)->group_change);
 }
 
+
 /*
-  Must be called with kernel_mutex held
+  Must be called with kernel_mutex held.
+
+  The PCB becomes invisible to get_pcb() at once, but it is recycled
+  only after concurrent lock-free readers are done with it.
 */
 void release_PCB(PCB* pcb)
 {
-  pcb->pstate = FREE;
-  pcb->parent = pcb_freelist;
-  pcb_freelist = pcb;
+  leave_group(pcb);
+  __atomic_store_n(&pcb->pstate, FREE, __ATOMIC_RELEASE);
   process_count--;
+
+  /* Our pid must not be reused while it is the pgid of a group */
+  if(is_rlist_empty(& pcb->group_members))
+    rcu_defer(&pcb->rcu, recycle_PCB, pcb);
+  else
+    pcb->group_held = 1;
 }
 
 
@@ -145,81 +336,189 @@ void start_new_thread(){
 
 
 
+/*
+  Process arguments.
+
+  The argument block of a process is reference-counted, so that the 
+  children created by a single ExecMany with identical arguments can
+  share one copy. The data is preceded by a header holding the count.
+
+  Exec always makes a private copy. Processes may write to their argument
+  (test_exec_copies_arguments does), and the VM has no page protection
+  to make a shared copy copy-on-write.
+ */
+typedef struct {
+  unsigned int refcount;
+  _Alignas(16) char data[];
+} args_block;
+
+#define ARGS_BLOCK(args) ((args_block*)((char*)(args) - offsetof(args_block, data)))
+
+static void* args_copy(int argl, void* args)
+{
+  args_block* blk = xmalloc(sizeof(args_block) + argl);
+  blk->refcount = 1;
+  memcpy(blk->data, args, argl);
+  return blk->data;
+}
+
+static void* args_share(void* args)
+{
+  ARGS_BLOCK(args)->refcount++;
+  return args;
+}
+
+void release_args(void* args)
+{
+  if(args == NULL) return;
+  args_block* blk = ARGS_BLOCK(args);
+  if(--blk->refcount == 0)
+    free(blk);
+}
+
+
+/* Make newproc a child of curproc, but do not inherit the file table */
+static void adopt_child(PCB* curproc, PCB* newproc)
+{
+  newproc->parent = curproc;
+  rlist_push_front(& curproc->children_list, & newproc->children_node);
+}
+
+
+/* 
+  Create the main thread of a new process, but do not wake it up.
+  The args (owned by the new process) must have been copied already.
+ */
+static TCB* spawn_main_thread(PCB* newproc, Task call, int argl, void* args)
+{
+  /* Set the main thread's function */
+  newproc->main_task = call;
+  newproc->argl = argl;
+  newproc->args = args;
+  if(args != NULL)
+    account_heap(newproc, argl);
+
+  if(call == NULL) return NULL;
+
+  /* 
+    For multi-threaded processes we have to create and initialize a PTCB and add it to the list
+    of ptcb in the new PCB. Then we create a new TCB and link it with the PTCB and increase
+    the number of threads.
+   */
+  PTCB* ptcb=createPTCB(call,argl,args);
+  attach_PTCB(newproc, ptcb);
+  TCB* tcb=spawn_thread(newproc,start_main_thread);
+  ptcb->tcb=tcb;
+  tcb->ptcb=ptcb;
+  newproc->thread_count++;
+  account_new_thread(newproc);
+  return tcb;
+}
+
+
 /*
 	System call to create a new process.
  */
 Pid_t sys_Exec(Task call, int argl, void* args)
 {
-  PCB *curproc, *newproc;
-  
-
+  PCB *curproc = NULL, *newproc;
   
   /* The new process PCB */
   newproc = acquire_PCB();
 
-
   if(newproc == NULL) goto finish;  /* We have run out of PIDs! */
 
   if(get_pid(newproc)<=1) {
     /* Processes with pid<=1 (the scheduler and the init process) 
        are parentless and are treated specially. */
     newproc->parent = NULL;
+    join_group(newproc, get_pid(newproc));
   }
   else
   {
     /* Inherit parent */
     curproc = CURPROC;
-
-    /* Add new process to the parent's child list */
-    newproc->parent = curproc;
-    rlist_push_front(& curproc->children_list, & newproc->children_node);
+    adopt_child(curproc, newproc);
+    join_group(newproc, curproc->pgid);
 
     /* Inherit file streams from parent */
-    for(int i=0; i<MAX_FILEID; i++) {
-       newproc->FIDT[i] = curproc->FIDT[i];
-       if(newproc->FIDT[i])
-          FCB_incref(newproc->FIDT[i]);
-    }
+    fidt_copy(newproc, curproc);
+    for(Fid_t fid = fidt_next(curproc, 0); fid != NOFILE; fid = fidt_next(curproc, fid+1))
+      FCB_incref(get_fcb(fid));
   }
 
+  /* 
+    Copy the arguments to new storage, owned by the new process, and
+    create and wake up the thread for the main function. This must be the last thing 
+    we do, because once we wakeup the new thread it may run! so we need to have finished
+    the initialization of the PCB.
+   */
+  TCB* tcb = spawn_main_thread(newproc, call, argl, 
+    (args != NULL) ? args_copy(argl, args) : NULL);
+  if(tcb != NULL)
+    wakeup(tcb);
 
-  /* Set the main thread's function */
-  newproc->main_task = call;
-
-  /* Copy the arguments to new storage, owned by the new process */
-  newproc->argl = argl;
-  if(args!=NULL) {
-    newproc->args = malloc(argl);
-    memcpy(newproc->args, args, argl);
-  }
-  else
-    newproc->args=NULL;
+finish:
+  return get_pid(newproc);
+}
 
-  /* 
-    For multi-threaded processes we have to create and initialize a PTCB and add it to the list
-    of ptcb in the new PCB. Then we create a new TCB and link it with the PTCB and increase
-    the number of threads.
 
+/*
+  System call to create many processes at once.
 
-  Create and wake up the thread for the main function. This must be the last thing 
-   we do, because once we wakeup the new thread it may run! so we need to have finished
-    the initialization of the PCB.
-   */
+  This does the work of count calls to Exec, but the PCBs are acquired 
+  at once, the reference counts of the inherited streams are increased
+  once per stream, argument blocks equal to the previous one are 
+  shared, and the main threads are made ready by a single scheduler
+  operation.
+ */
+int sys_ExecMany(Task call, unsigned int count, int argl, void* const* args, Pid_t* pids)
+{
+  if(argl < 0 || pids == NULL) return -1;
+  if(count == 0 || count > MAX_PROC) return -1;
+
+  PCB* curproc = CURPROC;
+  PCB** newprocs = xmalloc(count * sizeof(PCB*));
+  TCB** tcbs = xmalloc(count * sizeof(TCB*));
+
+  unsigned int got = acquire_PCBs(count, newprocs);
+
+  /* Inherit file streams from parent */
+  if(got > 0)
+    for(Fid_t fid = fidt_next(curproc, 0); fid != NOFILE; fid = fidt_next(curproc, fid+1))
+      FCB_incref_many(get_fcb(fid), got);
+
+  unsigned int nthreads = 0;
+  void* last_args = NULL;
+  for(unsigned int c=0; c<got; c++) {
+    PCB* newproc = newprocs[c];
+    adopt_child(curproc, newproc);
+    join_group(newproc, curproc->pgid);
+    fidt_copy(newproc, curproc);
+
+    /* Share the argument block with the previous child, if equal */
+    void* a = (args != NULL) ? args[c] : NULL;
+    void* kargs = NULL;
+    if(a != NULL) {
+      if(last_args != NULL && (a == args[c-1] || memcmp(a, last_args, argl) == 0))
+        kargs = args_share(last_args);
+      else
+        kargs = args_copy(argl, a);
+    }
+    last_args = kargs;
 
-  if(call != NULL) {
-    PTCB* ptcb=createPTCB(call,argl,args);
-    rlnode* ptcb_node=rlnode_init(&ptcb->ptcb_list_node,ptcb);
-    rlist_push_back(&newproc->ptcb_list,ptcb_node);
-    TCB* tcb=spawn_thread(newproc,start_main_thread);
-    ptcb->tcb=tcb;
-    tcb->ptcb=ptcb;
-    newproc->thread_count++;
-    wakeup(tcb);
+    TCB* tcb = spawn_main_thread(newproc, call, argl, kargs);
+    if(tcb != NULL)
+      tcbs[nthreads++] = tcb;
+    pids[c] = get_pid(newproc);
   }
 
+  /* Start them all */
+  wakeup_many(tcbs, nthreads);
 
-finish:
-  return get_pid(newproc);
+  free(tcbs);
+  free(newprocs);
+  return got;
 }
 
 
@@ -236,19 +535,68 @@ Pid_t sys_GetPPid()
 }
 
 
-static void cleanup_zombie(PCB* pcb, int* status)
+/*
+ *
+ * Resource accounting
+ *
+ */
+
+void fold_thread_usage(PCB* pcb, TCB* tcb)
+{
+  pcb->usage.cpu_time += tcb->cpu_time;
+  pcb->usage.ctx_switches += tcb->ctx_switches;
+  pcb->usage.bytes_read += tcb->bytes_read;
+  pcb->usage.bytes_written += tcb->bytes_written;
+}
+
+void get_proc_usage(PCB* pcb, proc_usage* usage)
+{
+  *usage = pcb->usage;
+  for(rlnode* n = pcb->ptcb_list.next; n != &pcb->ptcb_list; n = n->next) {
+    PTCB* ptcb = n->ptcb;
+    if(ptcb->exited || ptcb->tcb == NULL) continue;
+    TCB* tcb = ptcb->tcb;
+    usage->cpu_time += tcb->cpu_time;
+    usage->ctx_switches += tcb->ctx_switches;
+    usage->bytes_read += tcb->bytes_read;
+    usage->bytes_written += tcb->bytes_written;
+  }
+}
+
+
+/* Collect the exit status of a zombie child, and detach it from its parent */
+static void reap_zombie(PCB* pcb, int* status, proc_usage* usage)
 {
+  PCB* parent = pcb->parent;
+
   if(status != NULL)
     *status = pcb->exitval;
+  if(usage != NULL)
+    *usage = pcb->usage;
 
   rlist_remove(& pcb->children_node);
   rlist_remove(& pcb->exited_node);
+  pcb->parent = NULL;
+
+  /* Let any other waiters know that there is nothing left to wait for */
+  if(is_rlist_empty(& parent->children_list))
+    kernel_broadcast(& parent->child_exit);
+}
 
+static void cleanup_zombie(PCB* pcb, int* status, proc_usage* usage)
+{
+  reap_zombie(pcb, status, usage);
   release_PCB(pcb);
 }
 
 
-static Pid_t wait_for_specific_child(Pid_t cpid, int* status)
+/*
+  Threads waiting for a specific child sleep on the exit_wait condition
+  of the child, and only they are woken up when the child exits. The first
+  of them to run reaps the child, and the others find that the child is
+  no longer theirs. The PCB is released by the last one to leave.
+ */
+static Pid_t wait_for_specific_child(Pid_t cpid, int* status, proc_usage* usage)
 {
 
   /* Legality checks */
@@ -266,57 +614,204 @@ static Pid_t wait_for_specific_child(Pid_t cpid, int* status)
   }
 
   /* Ok, child is a legal child of mine. Wait for it to exit. */
-  while(child->pstate == ALIVE)
-    kernel_wait(& parent->child_exit, SCHED_USER);
-  
-  cleanup_zombie(child, status);
+  child->waited++;
+  while(child->pstate == ALIVE && ! is_killed(parent))
+    kernel_wait(& child->exit_wait, SCHED_USER);
+  child->waited--;
+
+  if(child->pstate == ALIVE || child->parent != parent) {
+    /* We were killed, or another thread reaped the child */
+    cpid = NOPROC;
+  }
+  else
+    reap_zombie(child, status, usage);
+
+  if(child->pstate == ZOMBIE && child->parent == NULL && child->waited == 0)
+    release_PCB(child);
   
 finish:
   return cpid;
 }
 
 
-static Pid_t wait_for_any_child(int* status)
+/* Return an exited child which is not waited for by its pid, or NULL */
+static PCB* find_unclaimed_zombie(PCB* parent)
 {
-  Pid_t cpid;
-
-  PCB* parent = CURPROC;
-
-  /* Make sure I have children! */
-  int no_children, has_exited;
-  while(1) {
-    no_children = is_rlist_empty(& parent->children_list);
-    if( no_children ) break;
+  for(rlnode* n = parent->exited_list.next; n != &parent->exited_list; n = n->next)
+    if(! n->pcb->waited) 
+      return n->pcb;
+  return NULL;
+}
 
-    has_exited = ! is_rlist_empty(& parent->exited_list);
-    if( has_exited ) break;
 
+/*
+  Wait until there is an unclaimed zombie child, or there are no children.
+  Return the zombie, or NULL if there are no children.
+ */
+static PCB* wait_for_zombie(PCB* parent)
+{
+  PCB* child;
+  while((child = find_unclaimed_zombie(parent)) == NULL) {
+    if(is_rlist_empty(& parent->children_list) || is_killed(parent)) 
+      return NULL;
     kernel_wait(& parent->child_exit, SCHED_USER);    
   }
+  assert(child->pstate == ZOMBIE);
+  return child;
+}
 
-  if(no_children)
-    return NOPROC;
 
-  PCB* child = parent->exited_list.next->pcb;
-  assert(child->pstate == ZOMBIE);
-  cpid = get_pid(child);
-  cleanup_zombie(child, status);
+static Pid_t wait_for_any_child(int* status, proc_usage* usage)
+{
+  PCB* child = wait_for_zombie(CURPROC);
+  if(child == NULL)
+    return NOPROC;
 
+  Pid_t cpid = get_pid(child);
+  cleanup_zombie(child, status, usage);
   return cpid;
 }
 
 
-Pid_t sys_WaitChild(Pid_t cpid, int* status)
+Pid_t sys_WaitChildUsage(Pid_t cpid, int* status, proc_usage* usage)
 {
   /* Wait for specific child. */
   if(cpid != NOPROC) {
-    return wait_for_specific_child(cpid, status);
+    return wait_for_specific_child(cpid, status, usage);
   }
   /* Wait for any child */
   else {
-    return wait_for_any_child(status);
+    return wait_for_any_child(status, usage);
+  }
+
+}
+
+
+Pid_t sys_WaitChild(Pid_t cpid, int* status)
+{
+  return sys_WaitChildUsage(cpid, status, NULL);
+}
+
+
+int sys_WaitChildren(Pid_t* pids, int* statuses, unsigned int max)
+{
+  PCB* parent = CURPROC;
+  unsigned int count = 0;
+
+  if(max == 0) return 0;
+
+  /* Wait for the first one, then take all the others that have exited */
+  PCB* child = wait_for_zombie(parent);
+  while(child != NULL && count < max) {
+    if(pids) pids[count] = get_pid(child);
+    cleanup_zombie(child, statuses ? &statuses[count] : NULL, NULL);
+    count++;
+    child = find_unclaimed_zombie(parent);
+  }
+
+  return count;
+}
+
+
+Pid_t sys_GetPgid(Pid_t pid)
+{
+  PCB* pcb = (pid == NOPROC) ? CURPROC : get_pcb(pid);
+  return (pcb == NULL) ? NOPROC : pcb->pgid;
+}
+
+
+int sys_SetPgid(Pid_t pid, Pid_t pgid)
+{
+  PCB* curproc = CURPROC;
+  PCB* pcb = (pid == NOPROC) ? curproc : get_pcb(pid);
+
+  /* We can only move ourselves, or a live child */
+  if(pcb == NULL || pcb->pstate != ALIVE) return -1;
+  if(pcb != curproc && pcb->parent != curproc) return -1;
+  if(get_pid(pcb) <= 1) return -1;
+
+  if(pgid == NOPROC) 
+    pgid = get_pid(pcb);
+  if(pgid != get_pid(pcb) && find_group(pgid) == NULL) return -1;
+
+  if(pgid != pcb->pgid) {
+    leave_group(pcb);
+    join_group(pcb, pgid);
+  }
+  return 0;
+}
+
+
+/*
+  Killing marks all the live members of the group, and wakes up their 
+  threads, in one pass over the group. Each thread then exits by itself,
+  at the next point where it holds the kernel lock (see exit_if_killed).
+ */
+int sys_KillGroup(Pid_t pgid, int exitval)
+{
+  PCB* g = find_group(pgid);
+  if(g == NULL) return -1;
+
+  TCB* self = cur_thread();
+  int count = 0;
+  for(rlnode* n = g->group_members.next; n != &g->group_members; n = n->next) {
+    PCB* pcb = n->pcb;
+    if(get_pid(pcb) <= 1 || pcb->pstate != ALIVE || pcb->killed) continue;
+
+    pcb->kill_status = exitval;
+    __atomic_store_n(& pcb->killed, 1, __ATOMIC_RELAXED);
+    count++;
+
+    for(rlnode* t = pcb->ptcb_list.next; t != &pcb->ptcb_list; t = t->next) {
+      PTCB* ptcb = t->ptcb;
+      if(! ptcb->exited && ptcb->tcb != self)
+        kernel_interrupt(ptcb->tcb);
+    }
   }
+  return count;
+}
+
+
+void exit_if_killed()
+{
+  /* There is no current thread during kernel initialization */
+  if(cur_thread() == NULL) return;
+  PCB* curproc = CURPROC;
+  if(is_killed(curproc))
+    sys_Exit(curproc->kill_status);
+}
+
 
+/* Return a zombie child in group pgid, which is not waited for by its pid, or NULL */
+static PCB* find_zombie_in_group(PCB* parent, Pid_t pgid)
+{
+  for(rlnode* n = parent->exited_list.next; n != &parent->exited_list; n = n->next)
+    if(n->pcb->pgid == pgid && ! n->pcb->waited) 
+      return n->pcb;
+  return NULL;
+}
+
+
+int sys_WaitGroup(Pid_t pgid)
+{
+  PCB* curproc = CURPROC;
+  PCB* g = find_group(pgid);
+  if(g == NULL || curproc->pgid == pgid) return -1;
+
+  /* Reap our own children in the group, and wait for the rest to be reaped */
+  int count = 0;
+  while(! is_rlist_empty(& g->group_members)) {
+    PCB* child = find_zombie_in_group(curproc, pgid);
+    if(child != NULL) {
+      cleanup_zombie(child, NULL, NULL);
+      count++;
+    }
+    else if(is_killed(curproc))
+      break;
+    else
+      kernel_wait(& g->group_change, SCHED_USER);
+  }
+  return count;
 }
 
 
@@ -334,7 +829,7 @@ void sys_Exit(int exitval)
    */
   if(get_pid(curproc)==1) {
 
-    while(sys_WaitChild(NOPROC,NULL)!=NOPROC);
+    while(sys_WaitChildren(NULL,NULL,MAX_PROC)>0);
   }
     sys_ThreadExit(exitval);  //call of sys_ThreadExit
 
@@ -343,8 +838,104 @@ void sys_Exit(int exitval)
 
 
 
+/*
+ *
+ * The procinfo stream
+ *
+ */
+
+/*
+  A procinfo stream is a cursor over the process table. It does not 
+  take a snapshot of the table; instead, each Read returns records for
+  the live PCBs that follow the cursor, as many as fit into the buffer.
+
+  Free PCBs are skipped without any lock, since get_pcb() is lock-free.
+  The kernel lock is held only while a single record is copied, so a 
+  monitor reading a large table does not stall the rest of the kernel.
+ */
+typedef struct procinfo_control_block {
+  Pid_t cursor;   /**< @brief The next pid to examine */
+} procinfo_cb;
+
+
+/* Copy the info of a PCB. Must be called with the kernel lock held. */
+static void fill_procinfo(PCB* pcb, procinfo* info)
+{
+  memset(info, 0, sizeof(procinfo));
+  info->pid = get_pid(pcb);
+  info->ppid = get_pid(pcb->parent);
+  info->alive = (pcb->pstate == ALIVE);
+  info->thread_count = pcb->thread_count;
+  info->main_task = pcb->main_task;
+  info->argl = pcb->argl;
+  if(pcb->args != NULL)
+    memcpy(info->args, pcb->args, 
+      (pcb->argl < PROCINFO_MAX_ARGS_SIZE) ? pcb->argl : PROCINFO_MAX_ARGS_SIZE);
+  get_proc_usage(pcb, &info->usage);
+}
+
+
+/* Called without the kernel lock (Read is an unlocked system call) */
+static int procinfo_read(void* this, char* buf, unsigned int size)
+{
+  procinfo_cb* picb = this;
+  if(size < sizeof(procinfo)) return -1;
+
+  unsigned int count = 0;
+  Pid_t maxpid = __atomic_load_n(&pt_chunks, __ATOMIC_ACQUIRE) * PT_CHUNK;
+
+  while(size - count >= sizeof(procinfo)) {
+    /* The stream may be shared, so advance the cursor atomically */
+    Pid_t pid = __atomic_load_n(&picb->cursor, __ATOMIC_RELAXED);
+    do {
+      if(pid >= maxpid) return count;
+    } while(! __atomic_compare_exchange_n(&picb->cursor, &pid, pid+1, 0,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if(get_pcb(pid) == NULL) continue;
+
+    /* Re-check under the lock, the process may have been reaped */
+    kernel_lock();
+    PCB* pcb = get_pcb(pid);
+    if(pcb != NULL) {
+      fill_procinfo(pcb, (procinfo*)(buf + count));
+      count += sizeof(procinfo);
+    }
+    kernel_unlock();
+  }
+
+  return count;
+}
+
+
+static int procinfo_close(void* this)
+{
+  free(this);
+  return 0;
+}
+
+
+static file_ops procinfo_fops = {
+  .Open = NULL,
+  .Read = procinfo_read,
+  .Write = NULL,
+  .Close = procinfo_close
+};
+
+
 Fid_t sys_OpenInfo()
 {
-	return NOFILE;
+  Fid_t fid;
+  FCB* fcb;
+
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  procinfo_cb* picb = xmalloc(sizeof(procinfo_cb));
+  picb->cursor = 0;
+
+  fcb->streamobj = picb;
+  fcb->streamfunc = &procinfo_fops;
+  return fid;
 }
 
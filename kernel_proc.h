@@ -17,6 +17,7 @@
 
 #include "tinyos.h"
 #include "kernel_sched.h"
+#include "kernel_cc.h"
 
 /**
   @brief PID state
@@ -30,12 +31,48 @@ typedef enum pid_state_e {
   ZOMBIE  /**< @brief The PID is held by a zombie */
 } pid_state;
 
+/**
+  @brief A slot of the thread table of a process.
+
+  @see attach_PTCB
+ */
+typedef struct thread_slot {
+  PTCB* ptcb;             /**< @brief The thread in this slot, or NULL for a free slot */
+  unsigned int gen;       /**< @brief Generation, incremented each time the slot is freed */
+  int next_free;          /**< @brief Next free slot, or -1 */
+} thread_slot;
+
+/**
+  @brief The fileid table of a process.
+
+  The table grows on demand, by doubling, up to @c MAX_FILEID slots. It is
+  read without the kernel lock (see @c get_fcb), so a new table is published 
+  atomically, and a replaced table is freed after an RCU grace period.
+
+  The used slots are marked in a bitmap. Two summary words have one bit for each 
+  word of the bitmap: in @c full the bit is set when the word is all ones, and in 
+  @c nonempty when the word is not zero. Thus, the lowest free fid and the next 
+  used fid are found by two find-first-set operations.
+
+  @see fidt_alloc
+ */
+typedef struct fid_table {
+  unsigned int size;      /**< @brief The number of slots, a multiple of 64 */
+  unsigned int count;     /**< @brief The number of used slots */
+  uint64_t full;          /**< @brief Bit @c w is set if @c used[w] is all ones */
+  uint64_t nonempty;      /**< @brief Bit @c w is set if @c used[w] is not zero */
+  uint64_t* used;         /**< @brief The bitmap of the used slots, after @c fcb */
+  rcu_callback rcu;       /**< @brief Used to defer freeing the table */
+  FCB* fcb[];             /**< @brief The slots, accessed atomically */
+} fid_table;
+
 /**
   @brief Process Control Block.
 
   This structure holds all information pertaining to a process.
  */
 typedef struct process_control_block {
+  Pid_t pid;              /**< @brief The pid of this PCB, fixed when the PCB is allocated */
   pid_state  pstate;      /**< @brief The pid state for this PCB */
 
   PCB* parent;            /**< @brief Parent's pcb. */
@@ -54,13 +91,46 @@ typedef struct process_control_block {
   rlnode ptcb_list;    //list of ptcbs
   int thread_count;    //number of threads connected to this pcb
 
-  CondVar child_exit;     /**< @brief Condition variable for @c WaitChild. 
+  thread_slot* thread_table;        /**< @brief The thread table, indexed by @c Tid_t */
+  unsigned int thread_table_size;   /**< @brief The number of slots in @c thread_table */
+  int thread_free;                  /**< @brief The first free slot of @c thread_table, or -1 */
+
+  CondVar child_exit;     /**< @brief Condition variable for @c WaitChild(NOPROC). 
+
+                             This condition variable is signalled once each time a child
+                             process terminates, unless the child is waited for by 
+                             @c WaitChild(pid). It is broadcast when the last child is 
+                             reaped, so that all waiters can return. */
+
+  CondVar exit_wait;      /**< @brief Condition variable for @c WaitChild(pid).
 
-                             This condition variable is  broadcast each time a child
-                             process terminates. It is used in the implementation of
-                             @c WaitChild() */
+                             The threads of the parent waiting for this process by its
+                             pid sleep here. */
+  int waited;             /**< @brief The number of threads of the parent waiting for this process
+                             by its pid. Such a zombie is not reaped by @c WaitChild(NOPROC). */
 
-  FCB* FIDT[MAX_FILEID];  /**< @brief The fileid table of the process */
+  Pid_t pgid;             /**< @brief The process group of the process */
+  rlnode group_node;      /**< @brief Intrusive node for the @c group_members of the group */
+  rlnode group_members;   /**< @brief The members of the process group whose pgid is our pid.
+                             The group outlives this process, as long as it has members. */
+  CondVar group_change;   /**< @brief Broadcast when a member of the group with our pid exits 
+                             or leaves the group */
+  int group_held;         /**< @brief Set when this PCB has been released, but it is not recycled
+                             until its group is empty */
+
+  unsigned int tls_used;  /**< @brief Bitmap of the allocated thread-local storage keys */
+  void (*tls_dtor[MAX_TLS_KEYS])(void*);  /**< @brief The destructors of the thread-local storage keys */
+
+  int killed;             /**< @brief Set when the process has been killed */
+  int kill_status;        /**< @brief The exit status of a killed process */
+
+  fid_table* FIDT;        /**< @brief The fileid table of the process, or NULL if
+                             it has never had a stream */
+
+  rcu_callback rcu;       /**< @brief Used to defer recycling of the PCB */
+
+  proc_usage usage;       /**< @brief Resource usage of the exited threads, and peak values */
+  unsigned long heap;     /**< @brief Kernel memory currently allocated for the process */
 
 } PCB;
 
@@ -73,6 +143,14 @@ typedef struct process_control_block {
 */
 void initialize_processes();
 
+/**
+  @brief Release the process table.
+
+  This function is called after the VM has halted, to free the 
+  memory of the process table.
+*/
+void finalize_processes();
+
 /**
   @brief Get the PCB for a PID.
 
@@ -80,6 +158,10 @@ void initialize_processes();
   the process with a given PID. If the PID does not
   correspond to a process, the function returns @c NULL.
 
+  This function does not need the kernel lock; when called inside an
+  RCU read-side section, the returned PCB will not be recycled before the
+  section ends.
+
   @param pid the pid of the process 
   @returns A pointer to the PCB of the process, or NULL.
 */
@@ -97,6 +179,191 @@ PCB* get_pcb(Pid_t pid);
 */
 Pid_t get_pid(PCB* pcb);
 
+
+/**
+  @brief Release the argument block of a process.
+
+  Argument blocks may be shared by processes created by @c ExecMany.
+  This must be called with the kernel lock held.
+
+  @param args the @c args field of the PCB, or NULL
+ */
+void release_args(void* args);
+
+/**
+  @brief Check if a process has been killed.
+
+  This can be called without the kernel lock. 
+
+  @param pcb the process, or NULL during kernel initialization
+ */
+static inline int is_killed(PCB* pcb)
+{
+  return pcb != NULL && __atomic_load_n(& pcb->killed, __ATOMIC_RELAXED);
+}
+
+/**
+  @brief Terminate the current thread, if its process has been killed.
+
+  A killed process is terminated one thread at a time: each thread exits when
+  it enters or leaves a system call. Blocking calls return early when the process
+  is killed (see @c kernel_wait). This must be called with the kernel lock held.
+
+  @see KillGroup
+ */
+void exit_if_killed();
+
+/**
+  @brief Wake up the threads waiting on the process group of a process.
+
+  This is called when the process exits. This must be called with the kernel lock held.
+ */
+void signal_group(PCB* pcb);
+
+/**
+  @brief Install a stream at the lowest free fid of a process.
+
+  The table is grown if needed. This must be called with the kernel lock held.
+
+  @param pcb the process
+  @param fcb the stream, not NULL
+  @returns the fid, or @c NOFILE if all @c MAX_FILEID fids are used
+ */
+Fid_t fidt_alloc(PCB* pcb, FCB* fcb);
+
+/**
+  @brief Set the stream of a fid of a process.
+
+  The table is grown if needed. This must be called with the kernel lock held.
+
+  @param pcb the process
+  @param fid a fid between 0 and @c MAX_FILEID-1
+  @param fcb the new stream, or NULL to free the fid
+  @returns the previous stream of the fid, or NULL
+ */
+FCB* fidt_set(PCB* pcb, Fid_t fid, FCB* fcb);
+
+/**
+  @brief Return the number of free fids of a process.
+ */
+static inline unsigned int fidt_free(PCB* pcb)
+{
+  return MAX_FILEID - (pcb->FIDT ? pcb->FIDT->count : 0);
+}
+
+/**
+  @brief Find the next used fid of a process.
+
+  A typical loop over the streams of a process is
+  @code
+  for(Fid_t fid = fidt_next(pcb, 0); fid != NOFILE; fid = fidt_next(pcb, fid+1))
+    ...
+  @endcode
+  which takes time proportional to the number of used fids.
+
+  @returns the lowest used fid that is not below @c fid, or @c NOFILE
+ */
+Fid_t fidt_next(PCB* pcb, Fid_t fid);
+
+/**
+  @brief Give a process a copy of the fileid table of another.
+
+  The reference counts of the streams are not changed.
+  This must be called with the kernel lock held.
+
+  @param pcb the process, whose table must be empty
+  @param from the process whose table is copied
+ */
+void fidt_copy(PCB* pcb, PCB* from);
+
+/**
+  @brief Free the (empty) fileid table of a process.
+ */
+void fidt_release(PCB* pcb);
+
+/**
+  @brief Add a thread to a process.
+
+  The PTCB is added to the thread list of the process, and it is given a slot 
+  in the thread table of the process. The @c Tid_t of the thread encodes the 
+  slot index and the generation of the slot, so that a stale @c Tid_t is not
+  mistaken for a later thread that reuses the same slot.
+
+  This must be called with the kernel lock held.
+
+  @param pcb the process
+  @param ptcb the new thread
+  @returns the new thread's @c Tid_t, or @c NOTHREAD if the table is full
+ */
+Tid_t attach_PTCB(PCB* pcb, PTCB* ptcb);
+
+/**
+  @brief Find a thread of a process by its @c Tid_t.
+
+  This is done in O(1). This must be called with the kernel lock held.
+
+  @param pcb the process
+  @param tid the thread id
+  @returns the PTCB of the thread, or NULL if @c tid is not a thread of @c pcb.
+ */
+PTCB* get_ptcb(PCB* pcb, Tid_t tid);
+
+/**
+  @brief Remove a thread from a process and free its PTCB.
+
+  The slot of the thread is recycled with a new generation.
+  This must be called with the kernel lock held.
+ */
+void release_PTCB(PCB* pcb, PTCB* ptcb);
+
+/**
+  @brief Free all the PTCBs and the thread table of a process.
+
+  This is called when the last thread of the process exits.
+ */
+void release_thread_table(PCB* pcb);
+
+/**
+  @brief Account for kernel memory allocated (or freed) for a process.
+
+  @param pcb the process
+  @param bytes the size allocated, or minus the size freed
+ */
+static inline void account_heap(PCB* pcb, long bytes)
+{
+  pcb->heap += bytes;
+  if(pcb->heap > pcb->usage.peak_heap)
+    pcb->usage.peak_heap = pcb->heap;
+}
+
+/**
+  @brief Account for a new thread of a process.
+
+  This must be called after @c thread_count is increased.
+ */
+static inline void account_new_thread(PCB* pcb)
+{
+  if(pcb->thread_count > pcb->usage.peak_threads) {
+    pcb->usage.peak_threads = pcb->thread_count;
+    pcb->usage.peak_stack = (unsigned long) pcb->thread_count * THREAD_STACK_SIZE;
+  }
+}
+
+/**
+  @brief Add the resource usage of an exiting thread to its process.
+
+  This must be called with the kernel lock held.
+ */
+void fold_thread_usage(PCB* pcb, TCB* tcb);
+
+/**
+  @brief Get the resource usage of a process.
+
+  The usage of the exited threads is added to the current counters of the 
+  live threads. This must be called with the kernel lock held.
+ */
+void get_proc_usage(PCB* pcb, proc_usage* usage);
+
 /** @} */
 
 #endif
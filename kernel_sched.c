@@ -83,7 +83,6 @@ TCB* cur_thread()
   with the exception of idle threads (they don't count).
  */
 volatile unsigned int active_threads = 0;
-Mutex active_threads_spinlock = MUTEX_INIT;
 
 /* This is specific to Intel Pentium! */
 #define SYSTEM_PAGE_SIZE (1 << 12)
@@ -172,6 +171,18 @@ TCB* spawn_thread(PCB* pcb, void (*func)())
 	tcb->rts = QUANTUM;
 	tcb->last_cause = SCHED_IDLE;
 	tcb->curr_cause = SCHED_IDLE;
+
+	tcb->last_core = cpu_core_id;
+	tcb->inbox_next = NULL;
+	tcb->inbox_pending = 0;
+
+	tcb->run_start = 0;
+	tcb->cpu_time = 0;
+	tcb->ctx_switches = 0;
+	tcb->bytes_read = 0;
+	tcb->bytes_written = 0;
+	tcb->wait_lock = NULL;
+	tcb->wait_guard = MUTEX_INIT;
 	
 	/* Compute the stack segment address and size */
 	void* sp = ((void*)tcb) + THREAD_TCB_SIZE;
@@ -184,9 +195,7 @@ TCB* spawn_thread(PCB* pcb, void (*func)())
 #endif
 
 	/* increase the count of active threads */
-	Mutex_Lock(&active_threads_spinlock);
-	active_threads++;
-	Mutex_Unlock(&active_threads_spinlock);
+	__atomic_fetch_add(&active_threads, 1, __ATOMIC_RELAXED);
 
 	return tcb;
 }
@@ -202,9 +211,11 @@ void release_TCB(TCB* tcb)
 
 	free_thread(tcb, THREAD_SIZE);
 
-	Mutex_Lock(&active_threads_spinlock);
-	active_threads--;
-	Mutex_Unlock(&active_threads_spinlock);
+	/* 
+		This is an atomic, not a mutex, because we may be called from an
+		interrupt handler (see ici_handler).
+	 */
+	__atomic_fetch_sub(&active_threads, 1, __ATOMIC_RELAXED);
 }
 
 /*
@@ -231,12 +242,22 @@ rlnode SCHED[PRIORITY_QUEUES]; /* Priority queues for Multilevel feedback queue*
 rlnode TIMEOUT_LIST; /* The list of threads with a timeout */
 Mutex sched_spinlock = MUTEX_INIT; /* spinlock for scheduler queue */
 
+static void sched_drain_inbox(); /* forward */
+
 /* Interrupt handler for ALARM */
-void yield_handler() { yield(SCHED_QUANTUM); }
+void yield_handler() 
+{ 
+	/* The alarm may be for a sleep deadline, before the end of the time slice */
+	yield(bios_clock_ns() < CURCORE.slice_end ? SCHED_TIMER : SCHED_QUANTUM);
+}
 
 /* Interrupt handle for inter-core interrupts */
 void ici_handler()
-{ /* noop for now... */
+{
+	/* Another core has woken up some threads for us */
+	Mutex_Lock(&sched_spinlock);
+	sched_drain_inbox();
+	Mutex_Unlock(&sched_spinlock);
 }
 
 /*
@@ -248,8 +269,8 @@ static void sched_register_timeout(TCB* tcb, TimerDuration timeout)
 {
 	if (timeout != NO_TIMEOUT) {
 		/* set the wakeup time */
-		TimerDuration curtime = bios_clock();
-		tcb->wakeup_time = (timeout == NO_TIMEOUT) ? NO_TIMEOUT : curtime + timeout;
+		TimerDuration curtime = bios_clock_ns();
+		tcb->wakeup_time = (timeout >= NO_TIMEOUT - curtime) ? NO_TIMEOUT-1 : curtime + timeout;
 
 		/* add to the TIMEOUT_LIST in sorted order */
 		rlnode* n = TIMEOUT_LIST.next;
@@ -277,30 +298,64 @@ static void sched_queue_add(TCB* tcb)
 }
 
 /*
-	Adjust the state of a thread to make it READY.
+	Change the state of a thread from STOPPED or INIT to READY.
+	Return 1 on success and 0 if the thread was in some other state.
 
-	*** MUST BE CALLED WITH sched_spinlock HELD ***
+	Since a thread can be woken up by another core without holding
+	sched_spinlock (see wakeup()), this change of state is done 
+	atomically. The rest of the work needed to make the thread ready is
+	done by sched_finish_ready(), while holding sched_spinlock.
  */
-static void sched_make_ready(TCB* tcb)
+static int sched_set_ready(TCB* tcb)
 {
-	assert(tcb->state == STOPPED || tcb->state == INIT);
+	Thread_state s = __atomic_load_n(&tcb->state, __ATOMIC_ACQUIRE);
+	while (s == STOPPED || s == INIT) {
+		if (__atomic_compare_exchange_n(&tcb->state, &s, READY, 0,
+				__ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+			return 1;
+	}
+	return 0;
+}
 
+/*
+	Finish making a READY thread ready: remove it from the TIMEOUT_LIST
+	and add it to the scheduler queue, if its context is clean and it
+	is not already queued. This can safely be called more than once
+	for the same thread.
+
+	*** MUST BE CALLED WITH sched_spinlock HELD ***
+ */
+static void sched_finish_ready(TCB* tcb)
+{
 	/* Possibly remove from TIMEOUT_LIST */
 	if (tcb->wakeup_time != NO_TIMEOUT) {
 		/* tcb is in TIMEOUT_LIST, fix it */
-		assert(tcb->sched_node.next != &(tcb->sched_node) && tcb->state == STOPPED);
+		assert(tcb->sched_node.next != &(tcb->sched_node));
 		rlist_remove(&tcb->sched_node);
 		tcb->wakeup_time = NO_TIMEOUT;
 	}
 
-	/* Mark as ready */
-	tcb->state = READY;
-
 	/* Possibly add to the scheduler queue */
-	if (tcb->phase == CTX_CLEAN)
+	if (tcb->state == READY && tcb->phase == CTX_CLEAN 
+		&& tcb->type != IDLE_THREAD
+		&& tcb->sched_node.next == &tcb->sched_node)
 		sched_queue_add(tcb);
 }
 
+/*
+	Adjust the state of a thread to make it READY.
+	Return 1 if the thread was STOPPED or INIT, 0 otherwise.
+
+	*** MUST BE CALLED WITH sched_spinlock HELD ***
+ */
+static int sched_make_ready(TCB* tcb)
+{
+	if (!sched_set_ready(tcb))
+		return 0;
+	sched_finish_ready(tcb);
+	return 1;
+}
+
 /*
   Scan the \c TIMEOUT_LIST for threads whose timeout has expired, and
   wake them up.
@@ -310,13 +365,110 @@ static void sched_make_ready(TCB* tcb)
 static void sched_wakeup_expired_timeouts()
 {
 	/* Empty the timeout list up to the current time and wake up each thread */
-	TimerDuration curtime = bios_clock();
+	TimerDuration curtime = bios_clock_ns();
 
 	while (!is_rlist_empty(&TIMEOUT_LIST)) {
 		TCB* tcb = TIMEOUT_LIST.next->tcb;
 		if (tcb->wakeup_time > curtime)
 			break;
-		sched_make_ready(tcb);
+		/* The thread may already be READY, if a remote wakeup is pending */
+		sched_set_ready(tcb);
+		sched_finish_ready(tcb);
+	}
+}
+
+
+/*
+	Remote wakeups.
+	---------------
+
+	When a thread is woken up by a core other than the one that last 
+	executed it, the waker does not take sched_spinlock. It changes the 
+	thread state atomically and pushes the TCB to the wakeup inbox of 
+	the thread's last core, raising an ICI to that core. The target core 
+	drains its inbox (in ici_handler and in yield) and finishes the job,
+	under sched_spinlock.
+
+	The inbox of each core is a lock-free stack (multiple producers, 
+	a single consumer which takes the whole stack at once).
+
+	The inbox_pending flag of a TCB is set while the TCB is (or is about
+	to be) in some inbox. A TCB cannot be in two inboxes at once, so a 
+	waker which finds the flag set does not push. The flag also pins the
+	TCB: an EXITED thread is not released by gain() while it is pending,
+	because the waker or the draining core may still access it.
+ */
+
+static void sched_inbox_push(uint core, TCB* tcb)
+{
+	CCB* ccb = & cctx[core];
+	TCB* head = __atomic_load_n(&ccb->inbox, __ATOMIC_RELAXED);
+	do {
+		tcb->inbox_next = head;
+	} while (!__atomic_compare_exchange_n(&ccb->inbox, &head, tcb, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+	Wake up a thread by pushing it to the inbox of another core.
+	This runs without sched_spinlock.
+ */
+static int wakeup_remote(TCB* tcb, uint core)
+{
+	/* Pin the TCB */
+	int pending = __atomic_exchange_n(&tcb->inbox_pending, 1, __ATOMIC_SEQ_CST);
+
+	int ret = sched_set_ready(tcb);
+
+	/* 
+		If the TCB was already pending, its inbox may have been drained 
+		before our state change was visible. Check again. 
+	 */
+	if (pending && ret)
+		pending = __atomic_exchange_n(&tcb->inbox_pending, 1, __ATOMIC_SEQ_CST);
+
+	/* 
+		If we set the pending flag, we must push, even if the state 
+		change failed. The draining core will clear the flag.
+	 */
+	if (!pending) {
+		sched_inbox_push(core, tcb);
+		cpu_ici(core);
+	}
+
+	return ret;
+}
+
+/*
+	Process the threads in the inbox of the current core.
+
+	*** MUST BE CALLED WITH sched_spinlock HELD ***
+ */
+static void sched_drain_inbox()
+{
+	TCB* list = __atomic_exchange_n(&CURCORE.inbox, NULL, __ATOMIC_ACQUIRE);
+
+	/* The inbox is a stack, reverse it to preserve the wakeup order */
+	TCB* rlist = NULL;
+	while (list) {
+		TCB* tcb = list;
+		list = tcb->inbox_next;
+		tcb->inbox_next = rlist;
+		rlist = tcb;
+	}
+
+	while (rlist) {
+		TCB* tcb = rlist;
+		rlist = tcb->inbox_next;
+
+		__atomic_store_n(&tcb->inbox_pending, 0, __ATOMIC_SEQ_CST);
+		Thread_state state = __atomic_load_n(&tcb->state, __ATOMIC_SEQ_CST);
+
+		if (state == READY)
+			sched_finish_ready(tcb);
+		else if (state == EXITED && tcb->phase == CTX_CLEAN)
+			/* gain() left this to us */
+			release_TCB(tcb);
 	}
 }
 
@@ -359,16 +511,15 @@ int wakeup(TCB* tcb)
 	/* Preemption off */
 	int oldpre = preempt_off;
 
-	/* To touch tcb->state, we must get the spinlock. */
-	Mutex_Lock(&sched_spinlock);
-
-	if (tcb->state == STOPPED || tcb->state == INIT) {
-		sched_make_ready(tcb);
-		ret = 1;
+	uint core = tcb->last_core;
+	if (core != cpu_core_id) {
+		ret = wakeup_remote(tcb, core);
+	} else {
+		Mutex_Lock(&sched_spinlock);
+		ret = sched_make_ready(tcb);
+		Mutex_Unlock(&sched_spinlock);
 	}
 
-	Mutex_Unlock(&sched_spinlock);
-
 	/* Restore preemption state */
 	if (oldpre)
 		preempt_on;
@@ -376,6 +527,30 @@ int wakeup(TCB* tcb)
 	return ret;
 }
 
+/*
+  Make many threads ready, locking the scheduler once.
+ */
+void wakeup_many(TCB** tcbs, unsigned int n)
+{
+	int oldpre = preempt_off;
+
+	Mutex_Lock(&sched_spinlock);
+	for (unsigned int i = 0; i < n; i++) {
+		if (tcbs[i]->last_core == cpu_core_id)
+			sched_make_ready(tcbs[i]);
+	}
+	Mutex_Unlock(&sched_spinlock);
+
+	for (unsigned int i = 0; i < n; i++) {
+		uint core = tcbs[i]->last_core;
+		if (core != cpu_core_id)
+			wakeup_remote(tcbs[i], core);
+	}
+
+	if (oldpre)
+		preempt_on;
+}
+
 /*
   Atomically put the current process to sleep, after unlocking mx.
  */
@@ -390,7 +565,7 @@ void sleep_releasing(Thread_state state, Mutex* mx, enum SCHED_CAUSE cause,
 	Mutex_Lock(&sched_spinlock);
 
 	/* mark the thread as stopped or exited */
-	tcb->state = state;
+	__atomic_store_n(&tcb->state, state, __ATOMIC_SEQ_CST);
 
 	/* register the timeout (if any) for the sleeping thread */
 	if (state != EXITED)
@@ -463,24 +638,12 @@ rlnode* helper_node=NULL; //used as buffer for changed priorities
 	current->last_cause = current->curr_cause;
 	current->curr_cause = cause;
 
+	/* Take in the threads woken up for us by other cores */
+	sched_drain_inbox();
+
 	/* Wake up threads whose sleep timeout has expired */
 	sched_wakeup_expired_timeouts();
 
-	/* Get next */
-	TCB* next = sched_queue_select(current);
-	assert(next != NULL);
-
-	/* Save the current TCB for the gain phase */
-	CURCORE.previous_thread = current;
-
-	Mutex_Unlock(&sched_spinlock);
-
-/* Switch contexts */
-	if (current != next) {
-		CURTHREAD = next;
-		cpu_swap_context(&current->context, &next->context);
-	}
-
 	yield_counter++;  //increase counter
 
 
@@ -491,9 +654,11 @@ rlnode* helper_node=NULL; //used as buffer for changed priorities
 	for(int j=PRIORITY_QUEUES-2; j>=0; j--){    // PRIORITY_QUEUES-2, because at priority_queue-1 the thread is at highest level
 			if(!is_rlist_empty(&SCHED[j])){
 
-				/*take last node of the queue with lower priority and put it in the front
-				of the queue with the next higher priority*/
-				helper_node=rlist_pop_back(&SCHED[j]); 
+				/*take the oldest node of the queue with lower priority and put it in the front
+				of the queue with the next higher priority. Taking the newest one would starve
+				the oldest, e.g. a preempted mutex holder behind threads that yield on the mutex*/
+				helper_node=rlist_pop_front(&SCHED[j]); 
+				helper_node->tcb->priority=j+1;
 				rlist_push_front(&SCHED[j+1],helper_node);
 
 
@@ -503,6 +668,21 @@ rlnode* helper_node=NULL; //used as buffer for changed priorities
 
 yield_counter=0; /*reinitialize the counter after increasing the priority of all threads*/
 }
+
+	/* Get next */
+	TCB* next = sched_queue_select(current);
+	assert(next != NULL);
+
+	/* Save the current TCB for the gain phase */
+	CURCORE.previous_thread = current;
+
+	Mutex_Unlock(&sched_spinlock);
+
+/* Switch contexts */
+	if (current != next) {
+		CURTHREAD = next;
+		cpu_swap_context(&current->context, &next->context);
+	}
 		
 	/* This is where we get after we are switched back on! A long time
 	   may have passed. Start a new timeslice...
@@ -532,18 +712,43 @@ void gain(int preempt)
 	current->state = RUNNING;
 	current->phase = CTX_DIRTY;
 	current->rts = current->its;
+	current->last_core = cpu_core_id;
 
 	/* Take care of the previous thread */
 	TCB* prev = CURCORE.previous_thread;
+
+	/* 
+		Start a new time slice, unless we just continue the current
+		thread after an alarm for a sleep deadline.
+	 */
+	TimerDuration now = bios_clock_ns();
+	if (current != prev || current->curr_cause != SCHED_TIMER)
+		CURCORE.slice_end = now + current->its * 1000;
+
+	/* Resource accounting, before prev can be scheduled by another core */
+	if (prev != NULL) {
+		prev->cpu_time += now - prev->run_start;
+		if (current != prev)
+			prev->ctx_switches++;
+	}
+	current->run_start = now;
+
+	/* The alarm is for the end of the slice or the earliest deadline */
+	TimerDuration alarm = CURCORE.slice_end;
+	if (!is_rlist_empty(&TIMEOUT_LIST) && TIMEOUT_LIST.next->tcb->wakeup_time < alarm)
+		alarm = TIMEOUT_LIST.next->tcb->wakeup_time;
+
 	if (current != prev) {
 		prev->phase = CTX_CLEAN;
 		switch (prev->state) {
 		case READY:
 			if (prev->type != IDLE_THREAD)
-				sched_queue_add(prev);
+				sched_finish_ready(prev);
 			break;
 		case EXITED:
-			release_TCB(prev);
+			/* If a remote wakeup is pending, the draining core releases it */
+			if (! __atomic_load_n(&prev->inbox_pending, __ATOMIC_SEQ_CST))
+				release_TCB(prev);
 			break;
 		case STOPPED:
 			break;
@@ -554,12 +759,15 @@ void gain(int preempt)
 
 	Mutex_Unlock(&sched_spinlock);
 
+	/* A context switch is a quiescent state for RCU */
+	rcu_quiescent();
+
 	/* Reset preemption as needed */
 	if (preempt)
 		preempt_on;
 
-	/* Set a 1-quantum alarm */
-	bios_set_timer(current->rts);
+	/* Set the alarm (in usec, rounded up) */
+	bios_set_timer(alarm > now ? (alarm - now + 999) / 1000 : 1);
 }
 
 static void idle_thread()
@@ -569,6 +777,7 @@ static void idle_thread()
 
 	/* We come here whenever we cannot find a ready thread for our core */
 	while (active_threads > 0) {
+		rcu_idle();
 		cpu_core_halt();
 		yield(SCHED_IDLE);
 	}
@@ -613,6 +822,13 @@ void run_scheduler()
 	curcore->idle_thread.curr_cause = SCHED_IDLE;
 	curcore->idle_thread.last_cause = SCHED_IDLE;
 
+	curcore->idle_thread.last_core = curcore->id;
+	curcore->idle_thread.inbox_pending = 0;
+	curcore->inbox = NULL;
+
+	rlnode_init(&curcore->rcu_deferred, NULL);
+	rcu_idle();
+
 	/* Initialize interrupt handler */
 	cpu_interrupt_handler(ALARM, yield_handler);
 	cpu_interrupt_handler(ICI, ici_handler);
@@ -623,6 +839,11 @@ void run_scheduler()
 
 	/* Finished scheduling */
 	assert(CURTHREAD == &CURCORE.idle_thread);
+	rcu_flush();
 	cpu_interrupt_handler(ALARM, NULL);
 	cpu_interrupt_handler(ICI, NULL);
+
+	/* The idle thread's process is freed on halt. A later boot must not
+	   find it, while it initializes the kernel without a current thread. */
+	curcore->current_thread = NULL;
 }
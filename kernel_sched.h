@@ -88,7 +88,8 @@ enum SCHED_CAUSE {
 	SCHED_PIPE, /**< @brief Sleep at a pipe or socket */
 	SCHED_POLL, /**< @brief The thread is polling a device */
 	SCHED_IDLE, /**< @brief The idle thread called yield */
-	SCHED_USER /**< @brief User-space code called yield */
+	SCHED_USER, /**< @brief User-space code called yield */
+	SCHED_TIMER /**< @brief The timer expired for a sleep deadline, before the quantum */
 };
 
 /**
@@ -110,7 +111,8 @@ typedef struct thread_control_block {
 
 	void (*thread_func)(); /**< @brief The initial function executed by this thread */
 
-	TimerDuration wakeup_time; /**< @brief The time this thread will be woken up by the scheduler */
+	TimerDuration wakeup_time; /**< @brief The time this thread will be woken up by the scheduler, 
+		in nanoseconds of @c bios_clock_ns() */
 
 	rlnode sched_node; /**< @brief Node to use when queueing in the scheduler queue */
 	TimerDuration its; /**< @brief Initial time-slice for this thread */
@@ -119,6 +121,26 @@ typedef struct thread_control_block {
 	enum SCHED_CAUSE curr_cause; /**< @brief The endcause for the current time-slice */
 	enum SCHED_CAUSE last_cause; /**< @brief The endcause for the last time-slice */
 
+	uint last_core; /**< @brief The core that last executed this thread */
+
+	/* 
+		Resource usage. These counters are updated only by the thread itself, or
+		by the scheduler at a context switch, so they need no locking. They are
+		folded into the PCB when the thread exits.
+	 */
+	TimerDuration run_start; /**< @brief When the thread was last switched in, in @c bios_clock_ns() time */
+	TimerDuration cpu_time; /**< @brief The total run time of the thread, in nanoseconds */
+	unsigned long ctx_switches; /**< @brief The number of times the thread was switched out */
+	unsigned long bytes_read; /**< @brief Bytes read by the thread via @c Read */
+	unsigned long bytes_written; /**< @brief Bytes written by the thread via @c Write */
+
+	Mutex* wait_lock; /**< @brief The lock held by the thread while it decides to sleep in a killable 
+		wait, or NULL. It is accessed under @c wait_guard. @see kernel_interrupt */
+	Mutex wait_guard; /**< @brief Protects @c wait_lock */
+
+	struct thread_control_block* inbox_next; /**< @brief Link in a core's wakeup inbox */
+	int inbox_pending; /**< @brief Set while this TCB may be in some core's wakeup inbox */
+
 #ifndef NVALGRIND
 	unsigned valgrind_stack_id; /**< @brief Valgrind helper for stacks. 
 
@@ -142,6 +164,7 @@ typedef struct thread_control_block {
 typedef struct process_thread_control_block{
 
 	TCB* tcb;           //pointer to connected tcb
+	Tid_t tid;          //handle of this thread in the thread table of the pcb
 	Task task;				
 	int argl;
 	void* args;
@@ -155,6 +178,8 @@ typedef struct process_thread_control_block{
 
 	rlnode ptcb_list_node;  //node to connect ptcbs with ptcb list in pcb
 
+	void* tls[MAX_TLS_KEYS];  //thread-local values, accessed only by the thread itself (see TLS_Get)
+
 } PTCB;
 
 /** @brief Thread stack size.
@@ -180,6 +205,13 @@ typedef struct core_control_block {
 	TCB* previous_thread; /**< @brief Points to the thread that previously owned the core */
 	TCB idle_thread; /**< @brief Used by the scheduler to handle the core's idle thread */
 
+	TCB* inbox; /**< @brief Lock-free stack of threads woken up by other cores */
+
+	TimerDuration slice_end; /**< @brief The end of the current time slice, in @c bios_clock_ns() time */
+
+	uint64_t rcu_qs; /**< @brief Global RCU epoch seen at this core's last quiescent state */
+	rlnode rcu_deferred; /**< @brief RCU callbacks deferred by this core */
+
 } CCB;
 
 /** @brief the array of Core Control Blocks (CCB) for the kernel */
@@ -239,12 +271,29 @@ TCB* spawn_thread(PCB* pcb, void (*func)());
   This call will change the state of a thread from @c STOPPED or @c INIT (where the
   thread is blocked) to @c READY. 
 
+  If the thread was last executed by a different core, this call does not 
+  touch the scheduler lock. Instead, the thread is pushed to the wakeup inbox
+  of that core, which is then interrupted (by an ICI) to put the thread to the
+  scheduler queue.
+
   @param tcb the thread to be made @c READY.
   @returns 1 if the thread state was @c STOPPED or @c INIT, 0 otherwise
 
 */
 int wakeup(TCB* tcb);
 
+/**
+  @brief Wakeup many blocked threads.
+
+  This is equivalent to calling @c wakeup() for each thread, but the 
+  scheduler lock is taken once for all threads last executed by the 
+  current core (e.g., new threads spawned by this core).
+
+  @param tcbs an array of threads to be made @c READY
+  @param n the number of threads in @c tcbs
+*/
+void wakeup_many(TCB** tcbs, unsigned int n);
+
 /** 
   @brief Block the current thread.
 
@@ -268,12 +317,13 @@ int wakeup(TCB* tcb);
 
 	A timeout can also be provided. If the timeout is not @c NO_TIMEOUT, then the thread will
 	be made ready by the scheduler after the timeout duration has passed, even without a call to
-	@c wakeup() by another thread.
+	@c wakeup() by another thread. The core timers are armed for the earliest timeout, so 
+	the thread is woken up close to its deadline, even if the quantum has not expired.
 
 	@param newstate the new state for the current thread, which must be either stopped or exited
 	@param mx the mutex to unlock.
 	@param cause the cause of the sleep
-	@param timeout a timeout for the sleep, or 
+	@param timeout a timeout for the sleep in nanoseconds, or @c NO_TIMEOUT
    */
 void sleep_releasing(Thread_state newstate, Mutex* mx, enum SCHED_CAUSE cause, TimerDuration timeout);
 
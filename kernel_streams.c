@@ -1,3 +1,5 @@
+#include <stddef.h>
+#include <limits.h>
 
 #include "util.h"
 #include "tinyos.h"
@@ -10,6 +12,7 @@
 
 FCB FT[MAX_FILES];
 rlnode FCB_freelist;
+Mutex FCB_freelist_lock = MUTEX_INIT;
 
 
 void initialize_files()
@@ -26,32 +29,55 @@ void initialize_files()
 
 FCB* acquire_FCB()
 {
-  if(! is_rlist_empty(& FCB_freelist)) {
-    FCB* fcb = rlist_pop_front(& FCB_freelist)->fcb;
+  FCB* fcb = NULL;
+
+  Mutex_Lock(& FCB_freelist_lock);
+  if(! is_rlist_empty(& FCB_freelist))
+    fcb = rlist_pop_front(& FCB_freelist)->fcb;
+  Mutex_Unlock(& FCB_freelist_lock);
+
+  if(fcb) {
     fcb->refcount = 0;
-    return fcb;
+    fcb->flags = 0;
   }
-  else
-    return NULL;
+  return fcb;
 }
 
-void release_FCB(FCB* fcb)
+/* RCU callback: return an FCB to the free list */
+static void recycle_FCB(void* obj)
 {
+  FCB* fcb = obj;
+  Mutex_Lock(& FCB_freelist_lock);
   rlist_push_back(& FCB_freelist, & fcb->freelist_node);
+  Mutex_Unlock(& FCB_freelist_lock);
+}
+
+/* 
+  The FCB is recycled only after concurrent lock-free readers 
+  (see get_fcb()) are done with it. 
+*/
+void release_FCB(FCB* fcb)
+{
+  rcu_defer(& fcb->rcu, recycle_FCB, fcb);
 }
 
 
 void FCB_incref(FCB* fcb)
 {
   assert(fcb);
-  fcb->refcount++;
+  __atomic_add_fetch(& fcb->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void FCB_incref_many(FCB* fcb, uint n)
+{
+  assert(fcb);
+  __atomic_add_fetch(& fcb->refcount, n, __ATOMIC_RELAXED);
 }
 
 int FCB_decref(FCB* fcb)
 {
   assert(fcb);
-  fcb->refcount --;
-  if(fcb->refcount==0) {
+  if(__atomic_sub_fetch(& fcb->refcount, 1, __ATOMIC_ACQ_REL)==0) {
     int retval = fcb->streamfunc->Close(fcb->streamobj);
     release_FCB(fcb);
     return retval;
@@ -62,20 +88,159 @@ int FCB_decref(FCB* fcb)
 
 
 
+/*
+ *
+ *   The fileid table
+ *
+ */
+
+_Static_assert(MAX_FILEID % 64 == 0 && MAX_FILEID <= 64*64, "MAX_FILEID must fit a 64-bit summary word");
+
+#define FIDT_MIN_SIZE 64
+
+static fid_table* fidt_new(PCB* pcb, unsigned int size)
+{
+  unsigned int words = size/64;
+  size_t bytes = sizeof(fid_table) + size*sizeof(FCB*) + words*sizeof(uint64_t);
+  fid_table* t = xmalloc(bytes);
+  account_heap(pcb, bytes);
+  t->size = size;
+  t->count = 0;
+  t->full = t->nonempty = 0;
+  t->used = (uint64_t*) & t->fcb[size];
+  memset(t->fcb, 0, size*sizeof(FCB*));
+  memset(t->used, 0, words*sizeof(uint64_t));
+  return t;
+}
+
+static void fidt_free_table(void* obj)
+{
+  free(obj);
+}
+
+static void fidt_retire(PCB* pcb, fid_table* t)
+{
+  account_heap(pcb, -(long)(sizeof(fid_table) + t->size*sizeof(FCB*) + (t->size/64)*sizeof(uint64_t)));
+  rcu_defer(& t->rcu, fidt_free_table, t);
+}
+
+/* Make sure that the table has a slot for fid, and return it */
+static fid_table* fidt_reserve(PCB* pcb, Fid_t fid)
+{
+  fid_table* t = pcb->FIDT;
+  if(t != NULL && fid < t->size) return t;
+
+  unsigned int size = (t != NULL) ? t->size : FIDT_MIN_SIZE;
+  while(size <= fid) size *= 2;
+  if(size > MAX_FILEID) size = MAX_FILEID;
+
+  fid_table* nt = fidt_new(pcb, size);
+  if(t != NULL) {
+    memcpy(nt->fcb, t->fcb, t->size*sizeof(FCB*));
+    memcpy(nt->used, t->used, (t->size/64)*sizeof(uint64_t));
+    nt->count = t->count;
+    nt->full = t->full;
+    nt->nonempty = t->nonempty;
+  }
+  /* Lock-free readers may still be using the old table */
+  __atomic_store_n(& pcb->FIDT, nt, __ATOMIC_RELEASE);
+  if(t != NULL) fidt_retire(pcb, t);
+  return nt;
+}
+
+FCB* fidt_set(PCB* pcb, Fid_t fid, FCB* fcb)
+{
+  assert(fid >= 0 && fid < MAX_FILEID);
+  fid_table* t = (fcb != NULL) ? fidt_reserve(pcb, fid) : pcb->FIDT;
+  if(t == NULL || fid >= t->size) return NULL;
+
+  FCB* old = t->fcb[fid];
+  __atomic_store_n(& t->fcb[fid], fcb, __ATOMIC_RELEASE);
+
+  unsigned int w = fid / 64;
+  uint64_t bit = 1ull << (fid % 64);
+  if(old == NULL && fcb != NULL) {
+    t->count++;
+    t->used[w] |= bit;
+    t->nonempty |= 1ull << w;
+    if(t->used[w] == ~0ull) t->full |= 1ull << w;
+  } 
+  else if(old != NULL && fcb == NULL) {
+    t->count--;
+    t->used[w] &= ~bit;
+    t->full &= ~(1ull << w);
+    if(t->used[w] == 0) t->nonempty &= ~(1ull << w);
+  }
+  return old;
+}
+
+Fid_t fidt_alloc(PCB* pcb, FCB* fcb)
+{
+  assert(fcb != NULL);
+  fid_table* t = pcb->FIDT;
+  Fid_t fid = 0;
+  if(t != NULL) {
+    if(t->count == MAX_FILEID) return NOFILE;
+
+    /* The lowest word that is not full; if all are, the first slot after the table */
+    unsigned int w = (~t->full == 0) ? 64 : __builtin_ctzll(~t->full);
+    fid = (w < t->size/64) ? w*64 + __builtin_ctzll(~t->used[w]) : t->size;
+  }
+  fidt_set(pcb, fid, fcb);
+  return fid;
+}
+
+Fid_t fidt_next(PCB* pcb, Fid_t fid)
+{
+  fid_table* t = pcb->FIDT;
+  if(t == NULL || fid < 0 || fid >= t->size) return NOFILE;
+
+  /* Look in the word of fid */
+  unsigned int w = fid / 64;
+  uint64_t bits = t->used[w] & (~0ull << (fid % 64));
+  if(bits) return w*64 + __builtin_ctzll(bits);
+
+  /* Look in the next nonempty word */
+  uint64_t words = (w == 63) ? 0 : t->nonempty & (~0ull << (w+1));
+  if(words == 0) return NOFILE;
+  w = __builtin_ctzll(words);
+  return w*64 + __builtin_ctzll(t->used[w]);
+}
+
+void fidt_copy(PCB* pcb, PCB* from)
+{
+  assert(pcb->FIDT == NULL);
+  fid_table* f = from->FIDT;
+  if(f == NULL || f->count == 0) return;
+
+  fid_table* t = fidt_new(pcb, f->size);
+  memcpy(t->fcb, f->fcb, f->size*sizeof(FCB*));
+  memcpy(t->used, f->used, (f->size/64)*sizeof(uint64_t));
+  t->count = f->count;
+  t->full = f->full;
+  t->nonempty = f->nonempty;
+  __atomic_store_n(& pcb->FIDT, t, __ATOMIC_RELEASE);
+}
+
+void fidt_release(PCB* pcb)
+{
+  fid_table* t = pcb->FIDT;
+  if(t == NULL) return;
+  assert(t->count == 0);
+  __atomic_store_n(& pcb->FIDT, NULL, __ATOMIC_RELEASE);
+  fidt_retire(pcb, t);
+}
+
+
+
 int FCB_reserve(size_t num, Fid_t *fid, FCB** fcb)
 {
     PCB* cur = CURPROC;
-    size_t f=0;
     uint i;
 
-    /* Find distinct fids */
-    for(i=0; i<num; i++) {
-	while(f<MAX_FILEID && cur->FIDT[f]!=NULL)
-	    f++;
-	if(f==MAX_FILEID) break;
-	fid[i] = f; f++;
-    }
-    if(i<num) return 0;
+    /* Check that there are enough fids */
+    if(fidt_free(cur) < num) return 0;
+
     /* Allocate FCBs */
     for(i=0;i<num;i++)
 	if((fcb[i] = acquire_FCB()) == NULL)
@@ -90,8 +255,9 @@ int FCB_reserve(size_t num, Fid_t *fid, FCB** fcb)
     }
     /* Found all */
     for(i=0;i<num;i++) {
-	cur->FIDT[fid[i]]=fcb[i];
 	FCB_incref(fcb[i]);
+	fid[i] = fidt_alloc(cur, fcb[i]);
+	assert(fid[i] != NOFILE);
     }
     return 1;
 }
@@ -102,8 +268,9 @@ void FCB_unreserve(size_t num, Fid_t *fid, FCB** fcb)
 {
     PCB* cur = CURPROC;
     for(size_t i=0; i<num ; i++) {
-	assert(cur->FIDT[fid[i]]==fcb[i]);
-	cur->FIDT[fid[i]] = NULL;
+	FCB* old = fidt_set(cur, fid[i], NULL);
+	assert(old==fcb[i]);
+	(void) old;
 	release_FCB(fcb[i]);
     }
 }
@@ -124,71 +291,321 @@ FCB* get_fcb(Fid_t fid)
 {
   if(fid < 0 || fid >= MAX_FILEID) return NULL;
 
-  return CURPROC->FIDT[fid];
+  fid_table* t = __atomic_load_n(& CURPROC->FIDT, __ATOMIC_ACQUIRE);
+  if(t == NULL || fid >= t->size) return NULL;
+  return __atomic_load_n(& t->fcb[fid], __ATOMIC_ACQUIRE);
+}
+
+
+/*
+  Read and Write are called without the kernel lock (see kernel_sys.h). 
+  
+  The FCB is found in an RCU read-side section, and a reference is taken 
+  only if the FCB is not already being closed. The last reference to be 
+  dropped closes the stream, under the kernel lock. Therefore, the 
+  device Read and Write methods must do their own locking.
+ */
+
+/* Get a reference to the FCB of a fid, or NULL */
+static FCB* FCB_get(Fid_t fid)
+{
+  int rcu = rcu_read_lock();
+  FCB* fcb = get_fcb(fid);
+  if(fcb) {
+    uint rc = __atomic_load_n(& fcb->refcount, __ATOMIC_RELAXED);
+    do {
+      if(rc == 0) { fcb = NULL; break; }  /* being closed */
+    } while(! __atomic_compare_exchange_n(& fcb->refcount, &rc, rc+1, 0,
+      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+  }
+  rcu_read_unlock(rcu);
+  return fcb;
+}
+
+/* Drop a reference taken by FCB_get */
+static void FCB_put(FCB* fcb)
+{
+  uint rc = __atomic_load_n(& fcb->refcount, __ATOMIC_RELAXED);
+  while(rc > 1) {
+    if(__atomic_compare_exchange_n(& fcb->refcount, &rc, rc-1, 0,
+      __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      return;
+  }
+
+  /* We may be the last one */
+  kernel_lock();
+  FCB_decref(fcb);
+  kernel_unlock();
 }
 
 
+/* Return the ready events of a stream, registering pe if not NULL */
+static int stream_poll(FCB* fcb, poll_entry* pe)
+{
+  int (*devpoll)(void*, poll_entry*) = fcb->streamfunc->Poll;
+  return devpoll ? devpoll(fcb->streamobj, pe) : (POLL_READ | POLL_WRITE);
+}
+
+/* Check if a stream has the STREAM_NONBLOCK flag */
+static inline int stream_nonblocking(FCB* fcb)
+{
+  return __atomic_load_n(& fcb->flags, __ATOMIC_RELAXED) & STREAM_NONBLOCK;
+}
+
+/* Check if a write to a non-blocking stream would block */
+static int write_would_block(FCB* fcb)
+{
+  return stream_nonblocking(fcb) 
+    && !(stream_poll(fcb, NULL) & (POLL_WRITE | POLL_ERROR | POLL_HANGUP));
+}
+
+/* forward */
+static int stream_tryreadv(FCB* fcb, const iovec_t* iov, unsigned int iovcnt);
+static int stream_trywritev(FCB* fcb, const iovec_t* iov, unsigned int iovcnt);
+
 int sys_Read(Fid_t fd, char *buf, unsigned int size)
 {
   int retcode = -1;
-  int (*devread)(void*,char*,uint);
-  void* sobj;
+  FCB* fcb = FCB_get(fd);
 
-  
-  /* Get the fields from the stream */
-  FCB* fcb = get_fcb(fd);
+  if(fcb) {
+    int (*devread)(void*,char*,uint) = fcb->streamfunc->Read;
+    if(devread && stream_nonblocking(fcb)) {
+      iovec_t iov = { buf, size };
+      retcode = stream_tryreadv(fcb, &iov, 1);
+    }
+    else if(devread)
+      retcode = devread(fcb->streamobj, buf, size);
+    FCB_put(fcb);
+    if(retcode > 0)
+      cur_thread()->bytes_read += retcode;
+  }
+
+  return retcode;
+}
+
+
+int sys_Write(Fid_t fd, const char *buf, unsigned int size)
+{
+  int retcode = -1;
+  FCB* fcb = FCB_get(fd);
 
   if(fcb) {
-    sobj = fcb->streamobj;
-    devread = fcb->streamfunc->Read;
+    int (*devwrite)(void*, const char*, uint) = fcb->streamfunc->Write;
+    if(devwrite && stream_nonblocking(fcb)) {
+      iovec_t iov = { (void*) buf, size };
+      retcode = stream_trywritev(fcb, &iov, 1);
+    }
+    else if(devwrite)
+      retcode = devwrite(fcb->streamobj, buf, size);
+    FCB_put(fcb);
+    if(retcode > 0)
+      cur_thread()->bytes_written += retcode;
+  }
 
-    /* make sure that the stream will not be closed (by another thread) 
-       while we are using it! */
-    FCB_incref(fcb);
-  
-    if(devread)
-      retcode = devread(sobj, buf, size);
+  return retcode;
+}
 
-    /* Need to decrease the reference to FCB */
-    FCB_decref(fcb);
+
+/* Return the total size of a vector, or -1 if it is not valid */
+static long iov_total(const iovec_t* iov, unsigned int iovcnt)
+{
+  if(iovcnt > MAX_IOV || (iov == NULL && iovcnt > 0)) return -1;
+  long total = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    total += iov[i].len;
+    if(total > INT_MAX) return -1;
   }
-  
-  /* We must not go into non-preemptive domain with kernel_mutex locked */
+  return total;
+}
 
+/*
+  Without a vectored method, the buffers are read one at a time. After some
+  data has been read, we go on only if the stream can be read without 
+  blocking, since a single read would not block either.
+ */
+static int readv_loop(FCB* fcb, const iovec_t* iov, unsigned int iovcnt)
+{
+  int total = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    if(iov[i].len == 0) continue;
+    if(total > 0 && !(stream_poll(fcb, NULL) & POLL_READ)) break;
+    int rc = fcb->streamfunc->Read(fcb->streamobj, iov[i].base, iov[i].len);
+    if(rc < 0) return (total > 0) ? total : rc;
+    total += rc;
+    if((unsigned int) rc < iov[i].len) break;
+  }
+  return total;
+}
 
-  return retcode;
+static int writev_loop(FCB* fcb, const iovec_t* iov, unsigned int iovcnt)
+{
+  int total = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    if(iov[i].len == 0) continue;
+    int rc = fcb->streamfunc->Write(fcb->streamobj, iov[i].base, iov[i].len);
+    if(rc < 0) return (total > 0) ? total : rc;
+    total += rc;
+    if((unsigned int) rc < iov[i].len) break;
+  }
+  return total;
 }
 
+/*
+  Read from a stream with the STREAM_NONBLOCK flag. The driver does this with
+  TryReadV, if it has one. Other streams are polled first, which is enough 
+  as long as no other thread takes the data between the poll and the read.
+ */
+static int stream_tryreadv(FCB* fcb, const iovec_t* iov, unsigned int iovcnt)
+{
+  file_ops* ops = fcb->streamfunc;
+  if(ops->TryReadV)
+    return ops->TryReadV(fcb->streamobj, iov, iovcnt);
+  if(!(stream_poll(fcb, NULL) & (POLL_READ | POLL_ERROR | POLL_HANGUP)))
+    return STREAM_WOULDBLOCK;
+  if(ops->ReadV)
+    return ops->ReadV(fcb->streamobj, iov, iovcnt);
+  return readv_loop(fcb, iov, iovcnt);
+}
 
-int sys_Write(Fid_t fd, const char *buf, unsigned int size)
+/*
+  Write to a stream with the STREAM_NONBLOCK flag. The driver does this with
+  TryWriteV, if it has one. Other streams are polled first.
+ */
+static int stream_trywritev(FCB* fcb, const iovec_t* iov, unsigned int iovcnt)
 {
-  int retcode = -1;
-  int (*devwrite)(void*, const char*, uint) = NULL;
-  void* sobj = NULL;
+  file_ops* ops = fcb->streamfunc;
+  if(ops->TryWriteV)
+    return ops->TryWriteV(fcb->streamobj, iov, iovcnt);
+  if(write_would_block(fcb))
+    return STREAM_WOULDBLOCK;
+  if(ops->WriteV)
+    return ops->WriteV(fcb->streamobj, iov, iovcnt);
+  return writev_loop(fcb, iov, iovcnt);
+}
 
-  
-  /* Get the fields from the stream */
-  FCB* fcb = get_fcb(fd);
+
+int sys_ReadV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt)
+{
+  if(iov_total(iov, iovcnt) < 0) return -1;
+
+  int retcode = -1;
+  FCB* fcb = FCB_get(fd);
 
   if(fcb) {
+    file_ops* ops = fcb->streamfunc;
+    if(ops->Read && stream_nonblocking(fcb))
+      retcode = stream_tryreadv(fcb, iov, iovcnt);
+    else if(ops->ReadV)
+      retcode = ops->ReadV(fcb->streamobj, iov, iovcnt);
+    else if(ops->Read)
+      retcode = readv_loop(fcb, iov, iovcnt);
+    FCB_put(fcb);
+    if(retcode > 0)
+      cur_thread()->bytes_read += retcode;
+  }
 
-    sobj = fcb->streamobj;
-    devwrite = fcb->streamfunc->Write;
+  return retcode;
+}
 
-    /* make sure that the stream will not be closed (by another thread) 
-       while we are using it! */
-    FCB_incref(fcb);
-  
 
-    if(devwrite)
-      retcode = devwrite(sobj, buf, size);
+int sys_WriteV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt)
+{
+  if(iov_total(iov, iovcnt) < 0) return -1;
 
-    /* Need to decrease the reference to FCB */
-    FCB_decref(fcb);
+  int retcode = -1;
+  FCB* fcb = FCB_get(fd);
 
+  if(fcb) {
+    file_ops* ops = fcb->streamfunc;
+    if(ops->Write && stream_nonblocking(fcb))
+      retcode = stream_trywritev(fcb, iov, iovcnt);
+    else if(ops->WriteV)
+      retcode = ops->WriteV(fcb->streamobj, iov, iovcnt);
+    else if(ops->Write)
+      retcode = writev_loop(fcb, iov, iovcnt);
+    FCB_put(fcb);
+    if(retcode > 0)
+      cur_thread()->bytes_written += retcode;
   }
 
+  return retcode;
+}
+
 
+/*
+  Splice copies through a buffer on the kernel stack. Without SPLICE_ALL, 
+  it goes on after the first chunk only while the input can be read without
+  blocking, as in readv_loop. A non-blocking output is checked before each 
+  chunk is read, so that data is not read when it cannot be written.
+
+  A chunk that has been read cannot be returned to the input. If the output 
+  fails in the middle of a chunk, the rest of the chunk is dropped, and only 
+  the bytes written are counted (see the Splice documentation).
+ */
+#define SPLICE_BUFFER_SIZE 4096
+
+int sys_Splice(Fid_t fd_in, Fid_t fd_out, unsigned int len, int flags)
+{
+  if(len > INT_MAX) return -1;
+
+  int retcode = -1;
+  FCB* in = FCB_get(fd_in);
+  FCB* out = FCB_get(fd_out);
+
+  if(in && out && in->streamfunc->Read && out->streamfunc->Write) {
+    int (*devread)(void*,char*,uint) = in->streamfunc->Read;
+    int (*devwrite)(void*,const char*,uint) = out->streamfunc->Write;
+    char buf[SPLICE_BUFFER_SIZE];
+    unsigned int total = 0;
+    int error = 0, blocked = 0;
+
+    while(total < len && ! is_killed(CURPROC)) {
+      if(total > 0 && !(flags & SPLICE_ALL) && !(stream_poll(in, NULL) & POLL_READ))
+        break;
+      if(write_would_block(out)) {
+        blocked = 1;
+        break;
+      }
+
+      unsigned int chunk = (len - total < SPLICE_BUFFER_SIZE) ? len - total : SPLICE_BUFFER_SIZE;
+      int n;
+      if(stream_nonblocking(in)) {
+        iovec_t iov = { buf, chunk };
+        n = stream_tryreadv(in, &iov, 1);
+        if(n == STREAM_WOULDBLOCK) {
+          blocked = 1;
+          break;
+        }
+      }
+      else
+        n = devread(in->streamobj, buf, chunk);
+      if(n < 0) error = 1;
+      if(n <= 0) break;
+      cur_thread()->bytes_read += n;
+
+      int written = 0;
+      while(written < n) {
+        int rc = devwrite(out->streamobj, buf + written, n - written);
+        if(rc <= 0) break;
+        written += rc;
+      }
+      cur_thread()->bytes_written += written;
+      total += written;
+      if(written < n) {
+        error = 1;
+        break;
+      }
+    }
+
+    if(total > 0)
+      retcode = total;
+    else
+      retcode = error ? -1 : blocked ? STREAM_WOULDBLOCK : 0;
+  }
+
+  if(in) FCB_put(in);
+  if(out) FCB_put(out);
   return retcode;
 }
 
@@ -200,7 +617,7 @@ int sys_Close(int fd)
   FCB* fcb = get_fcb(fd);
 
   if(fcb) {
-    CURPROC->FIDT[fd] = NULL;
+    fidt_set(CURPROC, fd, NULL);
     retcode = FCB_decref(fcb);    
   }
 
@@ -228,10 +645,10 @@ int sys_Dup2(int oldfd, int newfd)
     retcode = -1;
   }
   else if(old!=new) {
+    FCB_incref(old);
+    fidt_set(CURPROC, newfd, old);
     if(new)
       FCB_decref(new);
-    FCB_incref(old);
-    CURPROC->FIDT[newfd] = old;
   }
 
   return retcode;
@@ -239,6 +656,429 @@ int sys_Dup2(int oldfd, int newfd)
 
 
 
+int sys_SetFlags(Fid_t fd, int flags)
+{
+  FCB* fcb = get_fcb(fd);
+  if(fcb == NULL || (flags & ~STREAM_NONBLOCK)) return -1;
+  __atomic_store_n(& fcb->flags, flags, __ATOMIC_RELAXED);
+  return 0;
+}
+
+
+int sys_GetFlags(Fid_t fd)
+{
+  FCB* fcb = get_fcb(fd);
+  if(fcb == NULL) return -1;
+  return __atomic_load_n(& fcb->flags, __ATOMIC_RELAXED);
+}
+
+
+
+/* Return the deadline of a timeout in milliseconds, where a negative timeout means no timeout */
+static TimerDuration poll_deadline(timeout_t timeout)
+{
+  if((long) timeout < 0) return NO_TIMEOUT;
+  return bios_clock_ns() + (TimerDuration) timeout * 1000000ull;
+}
+
+/*
+  Poll is called without the kernel lock (see kernel_sys.h), like Read and Write.
+
+  The polled streams are referenced for the duration of the call. On the first
+  scan, each stream registers a poll entry at its wait queue. Afterwards, the 
+  thread sleeps until some stream wakes it up, and then it scans again. A wakeup
+  during a scan makes the thread scan once more, instead of sleeping.
+ */
+int sys_Poll(pollfd_t* fds, unsigned int nfds, timeout_t timeout)
+{
+  if((fds == NULL && nfds > 0) || nfds > MAX_FILEID)
+    return -1;
+
+  TimerDuration deadline = poll_deadline(timeout);
+
+  FCB** fcbs = xmalloc(nfds*sizeof(FCB*));
+  poll_entry* entries = xmalloc(nfds*sizeof(poll_entry));
+  poll_waiter waiter = { .lock = MUTEX_INIT, .wake = COND_INIT, .woken = 0 };
+
+  for(unsigned int i=0; i<nfds; i++) {
+    fcbs[i] = (fds[i].fd >= 0) ? FCB_get(fds[i].fd) : NULL;
+    entries[i].waiter = &waiter;
+    entries[i].queue = NULL;
+    entries[i].wake = NULL;
+  }
+
+  int ready;
+  int first = 1;
+  while(1) {
+    __atomic_store_n(& waiter.woken, 0, __ATOMIC_SEQ_CST);
+
+    ready = 0;
+    for(unsigned int i=0; i<nfds; i++) {
+      int revents = 0;
+      if(fds[i].fd < 0)
+        ;
+      else if(fcbs[i] == NULL)
+        revents = POLL_INVALID;
+      else {
+        int events = stream_poll(fcbs[i], first ? &entries[i] : NULL);
+        revents = events & (fds[i].events | POLL_ERROR | POLL_HANGUP);
+      }
+      fds[i].revents = revents;
+      if(revents) ready++;
+    }
+    first = 0;
+    if(ready > 0) break;
+
+    TimerDuration now = bios_clock_ns();
+    if(now >= deadline || is_killed(CURPROC)) break;
+
+    int pre = preempt_off;
+    Mutex_Lock(& waiter.lock);
+    if(! waiter.woken)
+      spinlock_wait(& waiter.lock, & waiter.wake, SCHED_IO, 
+        (deadline == NO_TIMEOUT) ? NO_TIMEOUT : deadline - now);
+    Mutex_Unlock(& waiter.lock);
+    if(pre) preempt_on;
+  }
+
+  for(unsigned int i=0; i<nfds; i++) {
+    wait_queue_remove(& entries[i]);
+    if(fcbs[i]) FCB_put(fcbs[i]);
+  }
+  free(entries);
+  free(fcbs);
+  return ready;
+}
+
+
+/*
+ *
+ *   Epoll
+ *
+ */
+
+/*
+  An epoll interest set keeps an item for each stream in it. The item stays 
+  registered at the wait queue of the stream, and when the stream wakes it up,
+  the item is appended to the ready list of the set (unless it is there already).
+  EpollWait takes items from the ready list, and polls their streams, to 
+  report their events. Level-triggered items that are still ready are appended 
+  again to the ready list.
+
+  The items are indexed by fid, and they are changed by EpollCtl and Close, under
+  the kernel lock. The ready list and the item flags are protected by the 
+  spinlock of the set, since wakeups may come from interrupt handlers. 
+  EpollWait runs without the kernel lock, so it holds a reference to each item 
+  it is using, and an item removed meanwhile is freed by the last reference.
+ */
+
+typedef struct epoll_control_block epoll_cb;
+
+typedef struct epoll_item {
+  epoll_cb* ep;           /* the set */
+  FCB* fcb;               /* the stream, referenced by the item */
+  Fid_t fd;
+  int events;             /* the requested events and flags */
+  void* data;
+
+  int in_ready;           /* set while the item is in the ready list */
+  int disabled;           /* set for a one-shot item that was reported */
+  int dead;               /* set when the item was removed from the set */
+  uint refcount;          /* one for the set, and one for each EpollWait using it */
+
+  poll_entry pe;          /* registered at the stream */
+  rlnode ready_node;
+} epoll_item;
+
+struct epoll_control_block {
+  Mutex lock;             /* a spinlock for the ready list and the item flags */
+  CondVar avail;          /* signalled when an item is added to the ready list */
+  rlnode ready;           /* the ready list */
+  wait_queue pollers;     /* woken up when an item is added to the ready list */
+
+  epoll_item** items;     /* the items, indexed by fid */
+  unsigned int items_size;
+};
+
+static file_ops epoll_fops;
+
+/* Append an item to the ready list, if needed. This is called with the set locked. */
+static int epoll_enqueue(epoll_cb* ep, epoll_item* it)
+{
+  if(it->dead || it->disabled || it->in_ready) return 0;
+  rlist_push_back(& ep->ready, & it->ready_node);
+  it->in_ready = 1;
+  Cond_Signal(& ep->avail);
+  return 1;
+}
+
+/* Called by wait_queue_wakeup of the stream */
+static void epoll_item_wake(poll_entry* pe)
+{
+  epoll_item* it = (epoll_item*) ((char*)pe - offsetof(epoll_item, pe));
+  epoll_cb* ep = it->ep;
+
+  int pre = preempt_off;
+  Mutex_Lock(& ep->lock);
+  int added = epoll_enqueue(ep, it);
+  Mutex_Unlock(& ep->lock);
+  if(added) wait_queue_wakeup(& ep->pollers);
+  if(pre) preempt_on;
+}
+
+/* Check the stream of an item, and append the item to the ready list if it is ready */
+static void epoll_check(epoll_cb* ep, epoll_item* it, int events)
+{
+  int added = 0;
+  int pre = preempt_off;
+  Mutex_Lock(& ep->lock);
+  if(events & (it->events | POLL_ERROR | POLL_HANGUP))
+    added = epoll_enqueue(ep, it);
+  Mutex_Unlock(& ep->lock);
+  if(pre) preempt_on;
+  if(added) wait_queue_wakeup(& ep->pollers);
+}
+
+/* Drop a reference to an item, returning 1 if it was the last one */
+static int epoll_item_decref(epoll_cb* ep, epoll_item* it)
+{
+  int pre = preempt_off;
+  Mutex_Lock(& ep->lock);
+  int last = (--it->refcount == 0);
+  Mutex_Unlock(& ep->lock);
+  if(pre) preempt_on;
+  return last;
+}
+
+/* Remove an item from the set. This is called with the kernel lock held. */
+static void epoll_remove(epoll_cb* ep, epoll_item* it)
+{
+  ep->items[it->fd] = NULL;
+
+  /* After this, the stream will not call epoll_item_wake */
+  wait_queue_remove(& it->pe);
+
+  int pre = preempt_off;
+  Mutex_Lock(& ep->lock);
+  it->dead = 1;
+  if(it->in_ready) {
+    rlist_remove(& it->ready_node);
+    it->in_ready = 0;
+  }
+  Mutex_Unlock(& ep->lock);
+  if(pre) preempt_on;
+
+  if(epoll_item_decref(ep, it)) {
+    FCB_decref(it->fcb);
+    free(it);
+  }
+}
+
+
+Fid_t sys_EpollCreate()
+{
+  Fid_t fid;
+  FCB* fcb;
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  epoll_cb* ep = xmalloc(sizeof(epoll_cb));
+  ep->lock = MUTEX_INIT;
+  ep->avail = COND_INIT;
+  rlnode_init(& ep->ready, NULL);
+  wait_queue_init(& ep->pollers);
+  ep->items = NULL;
+  ep->items_size = 0;
+
+  fcb->streamobj = ep;
+  fcb->streamfunc = & epoll_fops;
+  return fid;
+}
+
+
+int sys_EpollCtl(Fid_t epfd, epoll_op op, Fid_t fd, const epoll_event_t* event)
+{
+  FCB* epfcb = get_fcb(epfd);
+  FCB* fcb = get_fcb(fd);
+  if(epfcb == NULL || epfcb->streamfunc != & epoll_fops) return -1;
+  /* Interest sets do not nest, so there can be no cycles of them */
+  if(fcb == NULL || fcb->streamfunc == & epoll_fops) return -1;
+  if(op != EPOLL_DEL && event == NULL) return -1;
+
+  epoll_cb* ep = epfcb->streamobj;
+  epoll_item* it = (fd < ep->items_size) ? ep->items[fd] : NULL;
+
+  /* The fid was closed and re-opened */
+  if(it != NULL && it->fcb != fcb) {
+    epoll_remove(ep, it);
+    it = NULL;
+  }
+
+  switch(op) {
+  case EPOLL_ADD:
+    if(it != NULL) return -1;
+    if(fd >= ep->items_size) {
+      unsigned int size = (ep->items_size == 0) ? 16 : ep->items_size;
+      while(size <= fd) size *= 2;
+      ep->items = xrealloc(ep->items, size*sizeof(epoll_item*));
+      memset(ep->items + ep->items_size, 0, (size - ep->items_size)*sizeof(epoll_item*));
+      ep->items_size = size;
+    }
+
+    it = xmalloc(sizeof(epoll_item));
+    it->ep = ep;
+    it->fcb = fcb;
+    FCB_incref(fcb);
+    it->fd = fd;
+    it->events = event->events;
+    it->data = event->data;
+    it->in_ready = it->disabled = it->dead = 0;
+    it->refcount = 1;
+    it->pe.waiter = NULL;
+    it->pe.queue = NULL;
+    it->pe.wake = epoll_item_wake;
+    rlnode_init(& it->ready_node, it);
+    ep->items[fd] = it;
+
+    epoll_check(ep, it, stream_poll(fcb, & it->pe));
+    return 0;
+
+  case EPOLL_MOD:
+    if(it == NULL) return -1;
+    {
+      int pre = preempt_off;
+      Mutex_Lock(& ep->lock);
+      it->events = event->events;
+      it->data = event->data;
+      it->disabled = 0;
+      Mutex_Unlock(& ep->lock);
+      if(pre) preempt_on;
+    }
+    epoll_check(ep, it, stream_poll(fcb, NULL));
+    return 0;
+
+  case EPOLL_DEL:
+    if(it == NULL) return -1;
+    epoll_remove(ep, it);
+    return 0;
+
+  default:
+    return -1;
+  }
+}
+
+
+int sys_EpollWait(Fid_t epfd, epoll_event_t* events, unsigned int maxevents, timeout_t timeout)
+{
+  if(events == NULL || maxevents == 0) return -1;
+
+  /* A set holds at most one item per fid */
+  if(maxevents > MAX_FILEID) maxevents = MAX_FILEID;
+
+  FCB* epfcb = FCB_get(epfd);
+  if(epfcb == NULL) return -1;
+  if(epfcb->streamfunc != & epoll_fops) {
+    FCB_put(epfcb);
+    return -1;
+  }
+  epoll_cb* ep = epfcb->streamobj;
+
+  TimerDuration deadline = poll_deadline(timeout);
+  unsigned int count = 0;
+  epoll_item** batch = xmalloc(maxevents * sizeof(epoll_item*));
+
+  while(1) {
+    /* Take up to maxevents items from the ready list */
+    unsigned int n = 0;
+    int pre = preempt_off;
+    Mutex_Lock(& ep->lock);
+    while(n < maxevents && ! is_rlist_empty(& ep->ready)) {
+      epoll_item* it = rlist_pop_front(& ep->ready)->obj;
+      it->in_ready = 0;
+      it->refcount++;
+      batch[n++] = it;
+    }
+    Mutex_Unlock(& ep->lock);
+    if(pre) preempt_on;
+
+    /* Report the items that are really ready */
+    for(unsigned int i=0; i<n; i++) {
+      epoll_item* it = batch[i];
+      int revents = stream_poll(it->fcb, NULL);
+
+      int added = 0;
+      pre = preempt_off;
+      Mutex_Lock(& ep->lock);
+      revents &= it->events | POLL_ERROR | POLL_HANGUP;
+      if(revents && !it->dead && !it->disabled) {
+        events[count].events = revents;
+        events[count].data = it->data;
+        count++;
+        if(it->events & POLL_ONESHOT)
+          it->disabled = 1;
+        else if(! (it->events & POLL_EDGE))
+          added = epoll_enqueue(ep, it);
+      }
+      int last = (--it->refcount == 0);
+      Mutex_Unlock(& ep->lock);
+      if(pre) preempt_on;
+      if(added) wait_queue_wakeup(& ep->pollers);
+
+      if(last) {
+        FCB_put(it->fcb);
+        free(it);
+      }
+    }
+    if(count > 0) break;
+
+    TimerDuration now = bios_clock_ns();
+    if(now >= deadline || is_killed(CURPROC)) break;
+
+    pre = preempt_off;
+    Mutex_Lock(& ep->lock);
+    if(is_rlist_empty(& ep->ready))
+      spinlock_wait(& ep->lock, & ep->avail, SCHED_IO,
+        (deadline == NO_TIMEOUT) ? NO_TIMEOUT : deadline - now);
+    Mutex_Unlock(& ep->lock);
+    if(pre) preempt_on;
+  }
+
+  free(batch);
+  FCB_put(epfcb);
+  return count;
+}
+
+
+static int epoll_poll(void* this, poll_entry* pe)
+{
+  epoll_cb* ep = this;
+  if(pe) wait_queue_add(& ep->pollers, pe);
+
+  int pre = preempt_off;
+  Mutex_Lock(& ep->lock);
+  int events = is_rlist_empty(& ep->ready) ? 0 : POLL_READ;
+  Mutex_Unlock(& ep->lock);
+  if(pre) preempt_on;
+  return events;
+}
+
+static int epoll_close(void* this)
+{
+  epoll_cb* ep = this;
+  for(unsigned int fd=0; fd < ep->items_size; fd++)
+    if(ep->items[fd] != NULL)
+      epoll_remove(ep, ep->items[fd]);
+  free(ep->items);
+  free(ep);
+  return 0;
+}
+
+static file_ops epoll_fops = {
+  .Close = epoll_close,
+  .Poll = epoll_poll
+};
+
+
 unsigned int sys_GetTerminalDevices()
 {
   return device_no(DEV_SERIAL);
@@ -3,6 +3,7 @@
 
 #include "tinyos.h"
 #include "kernel_dev.h"
+#include "kernel_cc.h"
 
 /**
 	@file kernel_streams.h
@@ -40,10 +41,12 @@
  */
 typedef struct file_control_block
 {
-  uint refcount;  			/**< @brief Reference counter. */
+  uint refcount;  			/**< @brief Reference counter, accessed atomically. */
   void* streamobj;			/**< @brief The stream object (e.g., a device) */
   file_ops* streamfunc;		/**< @brief The stream implementation methods */
+  int flags;				/**< @brief The stream flags (see @c SetFlags), accessed atomically */
   rlnode freelist_node;		/**< @brief Intrusive list node */
+  rcu_callback rcu;			/**< @brief Used to defer recycling of the FCB */
 } FCB;
 
 
@@ -59,16 +62,28 @@ void initialize_files();
 /**
 	@brief Increase the reference count of an fcb 
 
+	The reference count is atomic, but the caller must already hold a 
+	reference to the fcb (e.g., through the FIDT, under the kernel lock).
+
 	@param fcb the fcb whose reference count will be increased
 */
 void FCB_incref(FCB* fcb);
 
+/**
+	@brief Increase the reference count of an fcb by @c n.
+
+	This is equivalent to @c n calls to @c FCB_incref.
+*/
+void FCB_incref_many(FCB* fcb, uint n);
+
 
 /**
 	@brief Decrease the reference count of the fcb.
 
 	If the reference count drops to 0, release the FCB, calling the 
-	Close method and returning its return value.
+	Close method and returning its return value. This must be called
+	with the kernel lock held. The FCB is recycled only after
+	an RCU grace period.
 	If the reference count is still >0, return 0. 
 
 	@param fcb  the fcb whose reference count is decreased
@@ -122,6 +137,10 @@ void FCB_unreserve(size_t num, Fid_t *fid, FCB** fcb);
 
 	This routine will return NULL if the fid is not legal.
 
+	This routine does not need the kernel lock; when called inside an
+	RCU read-side section, the returned FCB will not be recycled before 
+	the section ends.
+
 	@param fid the file ID to translate to a pointer to FCB
 	@returns a pointer to the corresponding FCB, or NULL.
  */
@@ -2,6 +2,7 @@
 #include "tinyos.h"
 #include "kernel_sys.h"
 #include "kernel_cc.h"
+#include "kernel_proc.h"
 
 #ifndef NVALGRIND
 #include <valgrind/valgrind.h>
@@ -14,10 +15,12 @@
 
 #define PRE_CALL \
 kernel_lock();\
+exit_if_killed();\
 
 
 
 #define POST_CALL \
+exit_if_killed();\
 kernel_unlock();\
 
 
@@ -41,6 +44,18 @@ void NAME SIG \
 	POST_CALL\
 }\
 
+/* without the kernel lock */
+#define SYSCALL_UNLOCKED(NAME, RET, SIG, ARGS)\
+RET NAME SIG \
+{\
+	RET __ret = sys_##NAME ARGS;\
+	if(cur_thread() != NULL && is_killed(CURPROC)) {\
+		kernel_lock();\
+		exit_if_killed();\
+	}\
+	return __ret;\
+}\
+
 
 SYSCALLS
 
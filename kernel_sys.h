@@ -6,22 +6,44 @@
 
 #define SYSCALLS \
 SYSCALL(Exec, int, (Task task, int argl, void* args), (task, argl, args))\
+SYSCALL(ExecMany, int, (Task task, unsigned int count, int argl, void* const* args, Pid_t* pids), \
+	(task, count, argl, args, pids))\
 SYSCALLV(Exit, (int exitval), (exitval))\
 SYSCALL(GetPid, int, (void), ())\
 SYSCALL(GetPPid, int, (void), ())\
 SYSCALL(WaitChild, Pid_t, (Pid_t proc, int* exitval), (proc, exitval))\
+SYSCALL(WaitChildUsage, Pid_t, (Pid_t proc, int* exitval, proc_usage* usage), (proc, exitval, usage))\
+SYSCALL(WaitChildren, int, (Pid_t* pids, int* exitvals, unsigned int max), (pids, exitvals, max))\
+SYSCALL(GetPgid, Pid_t, (Pid_t pid), (pid))\
+SYSCALL(SetPgid, int, (Pid_t pid, Pid_t pgid), (pid, pgid))\
+SYSCALL(KillGroup, int, (Pid_t pgid, int exitval), (pgid, exitval))\
+SYSCALL(WaitGroup, int, (Pid_t pgid), (pgid))\
 SYSCALL(CreateThread, Tid_t, (Task task, int argl, void* args), (task, argl, args))\
 SYSCALL(ThreadSelf, Tid_t, (void), ())\
 SYSCALL(ThreadJoin, int, (Tid_t tid, int* exitval), (tid, exitval))\
 SYSCALL(ThreadDetach, int, (Tid_t tid), (tid))\
 SYSCALLV(ThreadExit, (int exitval), (exitval))\
+SYSCALL(TLS_Alloc, tls_key_t, (void (*destructor)(void*)), (destructor))\
+SYSCALL(TLS_Free, int, (tls_key_t key), (key))\
+SYSCALL_UNLOCKED(GetTime, nsec_t, (), ())\
+SYSCALL_UNLOCKED(Sleep, int, (nsec_t ns), (ns))\
+SYSCALL_UNLOCKED(SleepUntil, int, (nsec_t deadline), (deadline))\
 SYSCALL(GetTerminalDevices, unsigned int, (), ())\
 SYSCALL(OpenTerminal, Fid_t, (unsigned int termno), (termno))\
 SYSCALL(OpenNull, Fid_t, (), ())\
-SYSCALL(Read,int,(Fid_t fd, char *buf, unsigned int size), (fd,buf,size))\
-SYSCALL(Write,int,(Fid_t fd, const char *buf, unsigned int size), (fd,buf,size))\
+SYSCALL_UNLOCKED(Read,int,(Fid_t fd, char *buf, unsigned int size), (fd,buf,size))\
+SYSCALL_UNLOCKED(Write,int,(Fid_t fd, const char *buf, unsigned int size), (fd,buf,size))\
+SYSCALL_UNLOCKED(ReadV, int, (Fid_t fd, const iovec_t* iov, unsigned int iovcnt), (fd, iov, iovcnt))\
+SYSCALL_UNLOCKED(WriteV, int, (Fid_t fd, const iovec_t* iov, unsigned int iovcnt), (fd, iov, iovcnt))\
+SYSCALL_UNLOCKED(Splice, int, (Fid_t fd_in, Fid_t fd_out, unsigned int len, int flags), (fd_in, fd_out, len, flags))\
 SYSCALL(Close,int,(Fid_t fd),(fd))\
 SYSCALL(Dup2,int, (Fid_t oldfd, Fid_t newfd), (oldfd,newfd))\
+SYSCALL(SetFlags, int, (Fid_t fd, int flags), (fd, flags))\
+SYSCALL(GetFlags, int, (Fid_t fd), (fd))\
+SYSCALL_UNLOCKED(Poll, int, (pollfd_t* fds, unsigned int nfds, timeout_t timeout), (fds, nfds, timeout))\
+SYSCALL(EpollCreate, Fid_t, (), ())\
+SYSCALL(EpollCtl, int, (Fid_t epfd, epoll_op op, Fid_t fd, const epoll_event_t* event), (epfd, op, fd, event))\
+SYSCALL_UNLOCKED(EpollWait, int, (Fid_t epfd, epoll_event_t* events, unsigned int maxevents, timeout_t timeout), (epfd, events, maxevents, timeout))\
 SYSCALL(Pipe, int, (pipe_t* pipe), (pipe))\
 SYSCALL(Socket, Fid_t, (port_t port), (port))\
 SYSCALL(Listen, int, (Fid_t sock), (sock))\
@@ -35,6 +57,13 @@ SYSCALL(OpenInfo, Fid_t, (), ())\
 #define SYSCALL(NAME, RET, SIG, ARGS)\
 RET sys_ ## NAME SIG;
 
+/* 
+	Syscalls declared with SYSCALL_UNLOCKED are called without the kernel 
+	lock. They must do their own locking.
+ */
+#define SYSCALL_UNLOCKED(NAME, RET, SIG, ARGS)\
+RET sys_ ## NAME SIG;
+
 /* without return */
 #define SYSCALLV(NAME, SIG, ARGS)\
 void sys_ ## NAME SIG;
@@ -43,5 +72,6 @@ SYSCALLS
 
 #undef SYSCALL
 #undef SYSCALLV
+#undef SYSCALL_UNLOCKED
 
 #endif
\ No newline at end of file
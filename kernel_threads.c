@@ -20,10 +20,95 @@ PTCB* createPTCB(Task call,int argl,void *args){
   ptcb->refcount=0;
   rlnode_init(&ptcb->ptcb_list_node,ptcb);
   ptcb->exit_cv=COND_INIT;
+  memset(ptcb->tls, 0, sizeof(ptcb->tls));
   return ptcb;
 }
 
 
+/*
+  The thread table.
+
+  A Tid_t is a slot index of the thread table of the process (plus one,
+  so that NOTHREAD is never valid), tagged with the generation of the
+  slot in the high bits. Freed slots are kept in a free list, and their
+  generation is incremented, so that stale tids are rejected.
+ */
+#define TID_INDEX_BITS 20
+#define TID_INDEX_MASK ((Tid_t)((1 << TID_INDEX_BITS)-1))
+#define THREAD_TABLE_MAX ((unsigned int)TID_INDEX_MASK)
+
+static inline Tid_t make_tid(unsigned int idx, unsigned int gen)
+{
+  return ((Tid_t)gen << TID_INDEX_BITS) | (idx+1);
+}
+
+Tid_t attach_PTCB(PCB* pcb, PTCB* ptcb)
+{
+  if(pcb->thread_free < 0) {
+    /* Grow the table */
+    unsigned int oldsize = pcb->thread_table_size;
+    if(oldsize == THREAD_TABLE_MAX) return NOTHREAD;
+    unsigned int newsize = (oldsize == 0) ? 4 : 2*oldsize;
+    if(newsize > THREAD_TABLE_MAX) newsize = THREAD_TABLE_MAX;
+
+    pcb->thread_table = xrealloc(pcb->thread_table, newsize*sizeof(thread_slot));
+    account_heap(pcb, (long)(newsize-oldsize)*sizeof(thread_slot));
+    for(unsigned int i = newsize; i > oldsize; i--) {
+      thread_slot* slot = & pcb->thread_table[i-1];
+      slot->ptcb = NULL;
+      slot->gen = 0;
+      slot->next_free = pcb->thread_free;
+      pcb->thread_free = i-1;
+    }
+    pcb->thread_table_size = newsize;
+  }
+
+  unsigned int idx = pcb->thread_free;
+  thread_slot* slot = & pcb->thread_table[idx];
+  pcb->thread_free = slot->next_free;
+  slot->ptcb = ptcb;
+  ptcb->tid = make_tid(idx, slot->gen);
+  account_heap(pcb, sizeof(PTCB));
+
+  rlist_push_back(& pcb->ptcb_list, rlnode_init(& ptcb->ptcb_list_node, ptcb));
+  return ptcb->tid;
+}
+
+PTCB* get_ptcb(PCB* pcb, Tid_t tid)
+{
+  Tid_t idx = (tid & TID_INDEX_MASK) - 1;   /* NOTHREAD wraps around */
+  if(idx >= pcb->thread_table_size) return NULL;
+  PTCB* ptcb = pcb->thread_table[idx].ptcb;
+  return (ptcb != NULL && ptcb->tid == tid) ? ptcb : NULL;
+}
+
+void release_PTCB(PCB* pcb, PTCB* ptcb)
+{
+  unsigned int idx = (ptcb->tid & TID_INDEX_MASK) - 1;
+  thread_slot* slot = & pcb->thread_table[idx];
+  slot->ptcb = NULL;
+  slot->gen++;
+  slot->next_free = pcb->thread_free;
+  pcb->thread_free = idx;
+
+  rlist_remove(& ptcb->ptcb_list_node);
+  free(ptcb);
+  account_heap(pcb, -(long)sizeof(PTCB));
+}
+
+void release_thread_table(PCB* pcb)
+{
+  while(! is_rlist_empty(& pcb->ptcb_list)) {
+    PTCB* ptcb = rlist_pop_front(& pcb->ptcb_list)->ptcb;
+    free(ptcb);
+  }
+  free(pcb->thread_table);
+  pcb->thread_table = NULL;
+  pcb->thread_table_size = 0;
+  pcb->thread_free = -1;
+}
+
+
   /*@brief Create a new thread in the current process.*/
 
 Tid_t sys_CreateThread(Task task, int argl, void* args)
@@ -34,19 +119,22 @@ Tid_t sys_CreateThread(Task task, int argl, void* args)
 
   PCB* curproc=CURPROC;   //get current process
   PTCB* newptcb=createPTCB(task,argl,args);  //initialize PTCB with curproc information
-  rlnode* ptcb_node=rlnode_init(&newptcb->ptcb_list_node,newptcb); 
 
-  /*Add created ptcb into ptcb list in pcb*/
-  rlist_push_back(&curproc->ptcb_list,ptcb_node);
+  /*Add created ptcb into ptcb list and thread table of the pcb*/
+  if(attach_PTCB(curproc,newptcb)==NOTHREAD){
+    free(newptcb);
+    return NOTHREAD;
+  }
 
   /*Call spawn thread to create tcb and connect it with ptcb*/
   TCB* newtcb=spawn_thread(curproc,start_new_thread);
   newtcb->ptcb=newptcb; 
   newptcb->tcb=newtcb;
   curproc->thread_count++; //increase thread counts
+  account_new_thread(curproc);
   wakeup(newtcb);         
 
-return (Tid_t) newptcb;
+return newptcb->tid;
 }
 
 /**
@@ -54,7 +142,7 @@ return (Tid_t) newptcb;
  */
 Tid_t sys_ThreadSelf()
 {
-	return (Tid_t) cur_thread()->ptcb;
+	return cur_thread()->ptcb->tid;
 }
 
 /**
@@ -64,20 +152,19 @@ int sys_ThreadJoin(Tid_t tid, int* exitval)
 {
 
   PCB* curproc=CURPROC;  //get current process
-  /*Find thread with the given tid inside the ptcb list in current pcb
+  /*Find thread with the given tid inside the thread table of the current pcb
   and if its not found or tries to join itself or is detached return -1;*/
-  rlnode* find_node=rlist_find(&curproc->ptcb_list,(PTCB*)tid,NULL);
-  if(find_node==NULL || tid==sys_ThreadSelf() || find_node->ptcb->detached==1){
+  PTCB* our_sweet_ptcb=get_ptcb(curproc,tid);
+  if(our_sweet_ptcb==NULL || tid==sys_ThreadSelf() || our_sweet_ptcb->detached==1){
     return -1;
   }
   else {   
 
     /*Else we increase refcount */
-    PTCB* our_sweet_ptcb=find_node->ptcb;
     our_sweet_ptcb->refcount++;
 
-    /*while ptcb is not exited or detached wait*/
-    while(!our_sweet_ptcb->exited && !our_sweet_ptcb->detached){
+    /*while ptcb is not exited or detached wait (unless we are killed)*/
+    while(!our_sweet_ptcb->exited && !our_sweet_ptcb->detached && !is_killed(curproc)){
       kernel_wait(&our_sweet_ptcb->exit_cv,SCHED_USER);
     }
 
@@ -85,9 +172,16 @@ int sys_ThreadJoin(Tid_t tid, int* exitval)
     our_sweet_ptcb->refcount--;
 
     if(our_sweet_ptcb->detached){ 
+      //the last joiner of an exited detached thread cleans it
+      if(our_sweet_ptcb->exited && our_sweet_ptcb->refcount==0)
+        release_PTCB(curproc,our_sweet_ptcb);
       return -1;
     }
 
+    //we were killed while waiting
+    if(!our_sweet_ptcb->exited)
+      return -1;
+
 
     //if we have an exitval set the current exitval to the given exitval
     if(exitval!=NULL){
@@ -96,9 +190,7 @@ int sys_ThreadJoin(Tid_t tid, int* exitval)
 
     //if no one is waiting for ptcb we clean it
     if(our_sweet_ptcb->refcount==0){
-      rlist_remove(&our_sweet_ptcb->ptcb_list_node);
-      free(our_sweet_ptcb);
-
+      release_PTCB(curproc,our_sweet_ptcb);
       }
 
       return 0;
@@ -114,36 +206,134 @@ int sys_ThreadJoin(Tid_t tid, int* exitval)
   */
 int sys_ThreadDetach(Tid_t tid)
 {
-	PCB* curproc=CURPROC;   //get current process
-  rlnode* find_node=rlist_find(&curproc->ptcb_list,(PTCB*)tid,NULL); /*search for given Tid in ptcb list
-  inside the pcb of current process*/
-  if(find_node==NULL){     
-    return -1;}      //if the node is not found return -1
-  else if (find_node->ptcb->exited==1){  //if the thread is exited it can't be detached so it returns -1
+  PTCB* ptcb=get_ptcb(CURPROC,tid);   /*search for given Tid in the thread table
+  of the current process*/
+  if(ptcb==NULL){     
+    return -1;}      //if the thread is not found return -1
+  else if (ptcb->exited==1){  //if the thread is exited it can't be detached so it returns -1
     return -1;}
   else{
-    find_node->ptcb->detached=1;       //we make the thread detached and wake up all the connected threads
-    kernel_broadcast(&find_node->ptcb->exit_cv);
+    ptcb->detached=1;       //we make the thread detached and wake up all the connected threads
+    kernel_broadcast(&ptcb->exit_cv);
     return 0;}
 
   }
   
 
+/*
+  Thread-local storage.
+
+  The keys are allocated per process, under the kernel lock. Each PTCB 
+  holds an array of values, which is only accessed by its own thread, so
+  TLS_Get and TLS_Set need no locks and no system calls.
+ */
+
+_Static_assert(MAX_TLS_KEYS <= 8*sizeof(unsigned int), "MAX_TLS_KEYS does not fit in tls_used");
+
+static inline int tls_key_valid(PCB* pcb, tls_key_t key)
+{
+  return key >= 0 && key < MAX_TLS_KEYS 
+    && (__atomic_load_n(& pcb->tls_used, __ATOMIC_RELAXED) & (1u << key));
+}
+
+tls_key_t sys_TLS_Alloc(void (*destructor)(void*))
+{
+  PCB* curproc = CURPROC;
+  for(tls_key_t key=0; key<MAX_TLS_KEYS; key++) {
+    if(curproc->tls_used & (1u << key)) continue;
+
+    /* A new key is NULL in all threads, even if it was used before */
+    for(rlnode* n = curproc->ptcb_list.next; n != &curproc->ptcb_list; n = n->next)
+      n->ptcb->tls[key] = NULL;
+
+    curproc->tls_dtor[key] = destructor;
+    __atomic_or_fetch(& curproc->tls_used, 1u << key, __ATOMIC_RELAXED);
+    return key;
+  }
+  return -1;
+}
+
+int sys_TLS_Free(tls_key_t key)
+{
+  PCB* curproc = CURPROC;
+  if(! tls_key_valid(curproc, key)) return -1;
+  __atomic_and_fetch(& curproc->tls_used, ~(1u << key), __ATOMIC_RELAXED);
+  curproc->tls_dtor[key] = NULL;
+  return 0;
+}
+
+void* TLS_Get(tls_key_t key)
+{
+  TCB* tcb = cur_thread();
+  return tls_key_valid(tcb->owner_pcb, key) ? tcb->ptcb->tls[key] : NULL;
+}
+
+int TLS_Set(tls_key_t key, void* value)
+{
+  TCB* tcb = cur_thread();
+  if(! tls_key_valid(tcb->owner_pcb, key)) return -1;
+  tcb->ptcb->tls[key] = value;
+  return 0;
+}
+
+/* 
+  Call the destructors of the thread-local values of a thread. The kernel lock is
+  released during each call, since destructors may make system calls.
+ */
+static void run_tls_destructors(PCB* pcb, PTCB* ptcb)
+{
+  for(int round=0; round<TLS_DESTRUCTOR_ROUNDS; round++) {
+    int called = 0;
+    for(tls_key_t key=0; key<MAX_TLS_KEYS; key++) {
+      void* value = ptcb->tls[key];
+      void (*dtor)(void*) = pcb->tls_dtor[key];
+      if(value == NULL || dtor == NULL || !(pcb->tls_used & (1u << key))) continue;
+
+      ptcb->tls[key] = NULL;
+      kernel_unlock();
+      dtor(value);
+      kernel_lock();
+      called = 1;
+    }
+    if(!called) break;
+  }
+}
+
+
 /**
   @brief Terminate the current thread.
   */
 void sys_ThreadExit(int exitval)
 {
+  run_tls_destructors(CURPROC, cur_thread()->ptcb);
 
-  PTCB* ptcb=(PTCB*) sys_ThreadSelf();  //get current thread
+
+  PTCB* ptcb=cur_thread()->ptcb;  //get current thread
   ptcb->exitval=exitval;       //save exitval          
   ptcb->exited=1;             //make thread exited
 
   PCB *curproc = CURPROC;    //get curproc
   curproc->thread_count--;   //decrease thread count
 
+  /*add the resource usage of this thread, up to now, to the process*/
+  int preempt=preempt_off;
+  TCB* tcb=cur_thread();
+  TimerDuration now=bios_clock_ns();
+  tcb->cpu_time+=now-tcb->run_start;
+  tcb->run_start=now;
+  fold_thread_usage(curproc,tcb);
+  if(preempt) preempt_on;
+
   kernel_broadcast(&ptcb->exit_cv);  //wake up all the threads that are waiting from Thread_Join
 
+  /*A detached thread cannot be joined, so nobody needs its ptcb*/
+  if(ptcb->detached && ptcb->refcount==0)
+    release_PTCB(curproc,ptcb);
+
+  /*Our ptcb may be freed from now on (above, by a joiner, or with the thread table),
+    so do not leave a dangling pointer to it*/
+  tcb->ptcb=NULL;
+
 
   if(curproc->thread_count==0){   //if it's the last thread from the current process 
 
@@ -160,16 +350,22 @@ void sys_ThreadExit(int exitval)
     }
 
     /* Add exited children to the initial task's exited list 
-       and signal the initial task */
-    if(!is_rlist_empty(& curproc->exited_list)) {
+       and signal the initial task, once for each */
+    unsigned int zombies = rlist_len(& curproc->exited_list);
+    if(zombies > 0) {
       rlist_append(& initpcb->exited_list, &curproc->exited_list);
-      kernel_broadcast(& initpcb->child_exit);
+      while(zombies--)
+        kernel_signal(& initpcb->child_exit);
     }
 
-    /* Put me into my parent's exited list */
+    /* Put me into my parent's exited list, and wake up the waiters
+       that are interested */
     if(curproc->parent!=NULL){
     rlist_push_front(& curproc->parent->exited_list, &curproc->exited_node);
-    kernel_broadcast(& curproc->parent->child_exit);
+    if(curproc->waited)
+      kernel_broadcast(& curproc->exit_wait);
+    else
+      kernel_signal(& curproc->parent->child_exit);
     }
   }
 
@@ -181,37 +377,26 @@ void sys_ThreadExit(int exitval)
    */
 
   /* Release the args data */
-  if(curproc->args) {
-    free(curproc->args);
-    curproc->args = NULL;
-  }
+  release_args(curproc->args);
+  curproc->args = NULL;
   
   /* Clean up FIDT */
-  for(int i=0;i<MAX_FILEID;i++) {
-    if(curproc->FIDT[i] != NULL) {
-      FCB_decref(curproc->FIDT[i]);
-      curproc->FIDT[i] = NULL;
-    }
-  }
+  for(Fid_t fid = fidt_next(curproc, 0); fid != NOFILE; fid = fidt_next(curproc, fid+1))
+    FCB_decref(fidt_set(curproc, fid, NULL));
+  fidt_release(curproc);
 
 
-  /*We clean ptcb from memory if it's exited and no one waits for it */
-  while(rlist_find(&curproc->ptcb_list,ptcb,FREE)!=NULL){
-    if(ptcb->refcount<1){
-      rlist_remove(&ptcb->ptcb_list_node);
-      free(ptcb);
-    }
-  }
-  
-
-  }
+  /*No thread of ours is left to join, so we clean all the ptcbs */
+  release_thread_table(curproc);
   
-
   /* Disconnect my main_thread */
   curproc->main_thread = NULL;
 
   /* Now, mark the process as exited. */
   curproc->pstate = ZOMBIE;
+  signal_group(curproc);
+
+  }
 
   /* Bye-bye cruel world */
   kernel_sleep(EXITED, SCHED_USER);
@@ -220,3 +405,40 @@ void sys_ThreadExit(int exitval)
 
 
 
+
+/*
+  Time and sleeping.
+
+  These are called without the kernel lock.
+ */
+
+nsec_t sys_GetTime()
+{
+  return bios_clock_ns();
+}
+
+int sys_Sleep(nsec_t ns)
+{
+  TimerDuration now = bios_clock_ns();
+  return sys_SleepUntil(ns < NO_TIMEOUT - now ? now + ns : NO_TIMEOUT - 1);
+}
+
+/*
+  Sleeping is a killable wait on a private condition, so that a KillGroup
+  between the is_killed check and the sleep is not lost.
+ */
+int sys_SleepUntil(nsec_t deadline)
+{
+  Mutex lock = MUTEX_INIT;
+  CondVar wake = COND_INIT;
+  TimerDuration now;
+
+  int pre = preempt_off;
+  Mutex_Lock(& lock);
+  while((now = bios_clock_ns()) < deadline && ! is_killed(CURPROC))
+    spinlock_wait(& lock, & wake, SCHED_USER, deadline - now);
+  Mutex_Unlock(& lock);
+  if(pre) preempt_on;
+  return 0;
+}
+
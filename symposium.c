@@ -176,19 +176,23 @@ int SymposiumOfProcesses(int argl, void* args)
   SymposiumTable S;
   SymposiumTable_init(&S, symp);
   
-  /* Execute philosophers */
+  /* Execute philosophers, all at once */
+  philosopher_args* Args = xmalloc(N * sizeof(philosopher_args));
+  void** argp = xmalloc(N * sizeof(void*));
+  Pid_t* pids = xmalloc(N * sizeof(Pid_t));
   for(int i=0;i<N;i++) {
-    philosopher_args Args;
-    Args.i = i;
-    Args.S = &S;
-    Exec(PhilosopherProcess, sizeof(Args), &Args);
+    Args[i].i = i;
+    Args[i].S = &S;
+    argp[i] = &Args[i];
   }  
+  int nproc = ExecMany(PhilosopherProcess, N, sizeof(philosopher_args), argp, pids);
 
   /* Wait for philosophers to exit */  
-  for(int i=0;i<N;i++) {
-    WaitChild(NOPROC, NULL);
-  }
+  while(WaitChildren(NULL, NULL, nproc) > 0);
 
+  free(pids);
+  free(argp);
+  free(Args);
   SymposiumTable_destroy(&S);
   return 0;
 }
@@ -283,6 +283,12 @@ void test_argv(size_t argc, const char* argv[])
 		ASSERT_MSG(strcmp(argv[i], uargv[i])==0, "In %s(%d): '%s'=='%s' failed for i=%d\n",
 			__FILE__, __LINE__, argv[i], uargv[i],i);
 	}
+
+	/* The view returns the same strings, without copying */
+	argview v = argview_init(argl, args);
+	for(int i=0;i<argc;i++)
+		ASSERT(argview_next(&v) == uargv[i]);
+	ASSERT(argview_next(&v) == NULL);
 }
 
 
@@ -35,6 +35,11 @@ typedef int Pid_t;		/* The PID type  */
 */
 typedef unsigned long timeout_t;
 
+/** @brief A time interval or a point in time, in nanoseconds. 
+	@see GetTime
+*/
+typedef uint64_t nsec_t;
+
 
 /** @brief The invalid PID */
 #define NOPROC (-1)
@@ -46,8 +51,9 @@ typedef unsigned long timeout_t;
 typedef int Fid_t;  
 
 /** @brief The maximum number of open files per process. 
-   Only values 0 to MAX_FILEID-1 are legal for file descriptors. */
-#define MAX_FILEID 16
+   Only values 0 to MAX_FILEID-1 are legal for file descriptors. 
+   This must be a multiple of 64, and at most 64*64. */
+#define MAX_FILEID 4096
 
 /** @brief The invalid file id. */
 #define NOFILE  (-1)
@@ -55,6 +61,10 @@ typedef int Fid_t;
 
 /**
   @brief The type of a thread ID.
+
+  A thread ID is an opaque handle, valid only within the process of 
+  the thread. The ID of a thread that has been cleaned up is not valid,
+  and it is not reused for a later thread.
   */
 typedef uintptr_t Tid_t;
 
@@ -92,7 +102,9 @@ typedef char Mutex;
 /** @brief Lock a mutex.
 
   Lock a mutex, by waiting if necessary, as long as it takes. In user-space and
-  in kernel-space (preemptive domain), the locking will yield after spinning for a few hundred times.
+  in kernel-space (preemptive domain), a waiting thread spins only while the owner 
+  is running on some core and it is expected to unlock the mutex soon, judging by 
+  the average hold time of the mutex. Otherwise, it yields immediately.
   In scheduler space (non-preemptive domain), the mutex lock operation is pure spinlock.
 
   @see Mutex
@@ -180,6 +192,21 @@ int Cond_Wait(Mutex* mx, CondVar* cv);
 int Cond_TimedWait(Mutex* mx, CondVar* cv, timeout_t timeout);
 
 
+/** @brief Wait on a condition variable, with a timeout in nanoseconds. 
+
+  This is the same as @c Cond_TimedWait, but the timeout is given in 
+  nanoseconds. The thread is woken up close to the end of the timeout,
+  subject to the precision of the host's timers.
+
+  @param mx The mutex to be unlocked as the thread sleeps.
+  @param cv The condition variable to sleep on.
+  @param timeout The time in nanoseconds to wait blocked on the condition.
+  @returns 1 if this thread was woken up by signal/broadcast, 0 otherwise
+  @see Cond_TimedWait
+  */
+int Cond_TimedWaitNs(Mutex* mx, CondVar* cv, nsec_t timeout);
+
+
 
 /** @brief Signal a condition variable. 
    
@@ -196,12 +223,81 @@ void Cond_Signal(CondVar*);
   Broadcast wakes up all threads sleeping on this condition variable.
   The calling thread is not preempted by the awoken threads.
 
+  The awoken threads do not all contend for the mutex at once. Instead,
+  they are woken up one after the other, each one after the previous
+  one has re-locked the mutex.
+
   @see Cond_Wait
   @see Cond_Signal
 */
 void Cond_Broadcast(CondVar*); 
 
 
+/** @brief The number of leaves of a barrier's combining tree.
+
+  This must be at least as large as the maximum number of cores.
+ */
+#define BARRIER_LEAVES 32
+
+/** @brief The fan-in of the inner nodes of a barrier's combining tree. */
+#define BARRIER_FANIN 4
+
+struct __barrier_waiter;
+
+/** @brief A node of a barrier's combining tree, in its own cache line. */
+struct barrier_node {
+  _Alignas(64) unsigned int count;  /**< Arrivals not yet forwarded to the parent */
+  struct __barrier_waiter* waiters; /**< Threads parked at this leaf */
+  Mutex lock;           /**< A mutex to protect `waiters` */
+};
+
+/** @brief Barriers.
+
+  A barrier synchronizes a fixed number of threads in phases: each
+  thread calling @c Barrier_Wait blocks, until all threads have called it.
+  The barrier is then released and can be reused for the next phase.
+
+  Arrivals are counted at a per-core leaf of a combining tree, and are
+  forwarded in batches towards the root, so that threads on different
+  cores do not all contend on one counter. Blocked threads park at the
+  leaf of their core, and the thread that completes a phase releases them
+  one leaf at a time.
+
+  @see Barrier_Init
+  @see Barrier_Wait
+ */
+typedef struct {
+  struct barrier_node leaf[BARRIER_LEAVES];               /**< Per-core arrival slots */
+  struct barrier_node group[BARRIER_LEAVES/BARRIER_FANIN]; /**< Inner nodes */
+  _Alignas(64) unsigned int arrived;  /**< Arrivals at the root in this phase */
+  unsigned int n;       /**< The number of threads to synchronize */
+  unsigned int epoch;   /**< The number of completed phases */
+} Barrier;
+
+
+/** @brief Initialize a barrier for @c n threads.
+
+  @param bar the barrier to initialize
+  @param n the number of threads that synchronize at each phase, must be positive
+  */
+void Barrier_Init(Barrier* bar, unsigned int n);
+
+
+/** @brief Wait at a barrier.
+
+  The calling thread blocks until @c n threads (as given to @c Barrier_Init)
+  have called this function in the current phase. A thread will spin 
+  for a short while before it blocks.
+
+  @param bar the barrier to wait on
+  @returns 1 for exactly one thread of each phase (the one that completed it),
+     and 0 for all other threads
+  @see Barrier_Init
+  */
+int Barrier_Wait(Barrier* bar);
+
+
+
 /*******************************************
  *
  * Process creation
@@ -241,6 +337,34 @@ typedef int (*Task)(int, void*);
 Pid_t Exec(Task task, int argl, void* args);
 
 
+/** @brief Create many processes.
+
+  This call is equivalent to @c count calls to @c Exec, with the same
+  @c task and argument length. The i-th process is passed a copy of the 
+  byte array at @c args[i], of length @c argl. If @c args is NULL, or 
+  @c args[i] is NULL, the i-th process is passed a NULL byte array.
+
+  This call is faster than the equivalent calls to @c Exec. The processes 
+  are allocated in one batch, and consecutive processes with identical 
+  arguments share the same copy of the byte array. Therefore, processes
+  should not modify their argument.
+
+  @param task the main function of the new processes
+  @param count the number of processes to create, from 1 to @c MAX_PROC
+  @param argl the length of each byte array in @c args
+  @param args an array of @c count byte arrays, or NULL
+  @param pids an array of size @c count, where the pids of the new
+     processes are returned
+  @return the number of processes created, which is less than @c count
+    if the maximum number of processes has been reached, or -1 on error.
+    Possible errors are:
+    - @c count is 0, or larger than @c MAX_PROC.
+    - @c argl is negative, or @c pids is NULL.
+  @see Exec
+  */
+int ExecMany(Task task, unsigned int count, int argl, void* const* args, Pid_t* pids);
+
+
 /** @brief Exit the current process.
 
   When this function is called by a process thread, the process terminates
@@ -268,6 +392,11 @@ void Exit(int val);
    If parameter @c exitval is a not null, the exit code of the child
    process will be stored in the variable pointed to by status.
 
+   Several threads may wait for the same child by its pid. When the child 
+   exits, exactly one of them gets its exit status, and the others return
+   @c NOPROC. A child waited for by its pid is not returned by 
+   @c WaitChild(NOPROC).
+
     @param pid the process ID of the child to wait on, or @c NOPROC to
            designate waiting for any child.
     @param exitval a location whithin which the exit status of the terminates
@@ -276,9 +405,53 @@ void Exit(int val);
    - the specified pid is not a valid pid.
    - the specified process is not a child of this process.
    - the process has no child processes to wait on (when pid=NOPROC).
+   - another thread of this process waited for the specified process, and
+     got its exit status.
 */
 Pid_t WaitChild(Pid_t pid, int* exitval);
 
+/** @brief Wait for many child processes to exit.
+
+   This call waits until some child process has exited, like 
+   @c WaitChild(NOPROC,...), and then cleans up all the exited 
+   children, up to @c max. Children that are waited for by their pid
+   by another thread, are not cleaned up.
+
+   @param pids if not NULL, an array of size @c max to store the pids of
+      the cleaned up children
+   @param exitvals if not NULL, an array of size @c max to store the exit
+      status of the cleaned up children
+   @param max the maximum number of children to clean up
+   @return the number of children cleaned up, which is 0 if the process
+      has no child processes to wait on.
+*/
+int WaitChildren(Pid_t* pids, int* exitvals, unsigned int max);
+
+/** @brief Resource usage of a process.
+
+   @see WaitChildUsage
+   @see procinfo
+  */
+typedef struct proc_usage {
+  nsec_t cpu_time;              /**< @brief CPU time of all threads, in nanoseconds */
+  unsigned long ctx_switches;   /**< @brief The number of times a thread was switched out */
+  unsigned long bytes_read;     /**< @brief Bytes read by @c Read, from any stream */
+  unsigned long bytes_written;  /**< @brief Bytes written by @c Write, to any stream */
+  unsigned int peak_threads;    /**< @brief The maximum number of threads at any time */
+  unsigned long peak_stack;     /**< @brief The maximum memory used for thread stacks */
+  unsigned long peak_heap;      /**< @brief The maximum kernel memory allocated for the process 
+                                    (arguments and thread tables) */
+} proc_usage;
+
+/** @brief Wait for a child process to exit, and get its resource usage.
+
+   This call is like @c WaitChild, and in addition, if @c usage is not 
+   NULL, it stores the resource usage of the exited child.
+
+   @see WaitChild
+*/
+Pid_t WaitChildUsage(Pid_t pid, int* exitval, proc_usage* usage);
+
 /** @brief Return the PID of the caller.
 
  This function returns the pid of the current process 
@@ -291,6 +464,61 @@ Pid_t GetPid(void);
  */
 Pid_t GetPPid(void);
 
+/** @brief Return the process group of a process.
+
+  A process group is a set of processes that can be killed and waited 
+  for together. It is identified by a pgid, which is the pid of the process
+  that created it. A new process is a member of the group of its parent.
+  The group exists as long as it has members (which may be zombies), and
+  its pgid is not reused as a pid before that.
+
+  @param pid the process, or NOPROC for the caller
+  @returns the pgid of the process, or NOPROC if @c pid is not a process
+  @see SetPgid
+ */
+Pid_t GetPgid(Pid_t pid);
+
+/** @brief Move a process to a process group.
+
+  The process must be the caller or a live child of the caller.
+  If @c pgid is NOPROC or equal to @c pid, the process is moved to the group 
+  whose pgid is its pid, which is created if it does not exist. Else, the 
+  process group must exist.
+
+  @param pid the process, or NOPROC for the caller
+  @param pgid the process group, or NOPROC
+  @returns 0 on success, or -1 on error.
+ */
+int SetPgid(Pid_t pid, Pid_t pgid);
+
+/** @brief Kill all the processes of a process group.
+
+  All the live members of the group (except the init process) are marked as killed, 
+  and their threads that are blocked in the kernel are woken up, in a single pass.
+  A killed process terminates with exit status @c exitval. Each of its threads
+  exits the next time it blocks in the kernel or it enters or returns from a system
+  call; a thread that runs without system calls is not stopped.
+
+  If the caller is a member of the group, it terminates when this call returns.
+
+  @param pgid the process group
+  @param exitval the exit status of the killed processes
+  @returns the number of processes killed, or -1 if there is no such group.
+ */
+int KillGroup(Pid_t pgid, int exitval);
+
+/** @brief Wait until all the members of a process group have been reaped.
+
+  Exited children of the caller in the group are reaped by this call. Other
+  members are reaped by their own parents. The caller must not be a member of
+  the group.
+
+  @param pgid the process group
+  @returns the number of children reaped by the call, or -1 if there is no 
+    such group, or the caller is a member.
+ */
+int WaitGroup(Pid_t pgid);
+
 /*******************************************
  *
  * Threads
@@ -371,10 +599,105 @@ int ThreadDetach(Tid_t tid);
 
 /**
   @brief Terminate the current thread.
+
+  Before the thread terminates, the destructors of its thread-local values 
+  are called (see @c TLS_Alloc).
   */
 void ThreadExit(int exitval);
 
 
+/** @brief The maximum number of thread-local storage keys of a process. */
+#define MAX_TLS_KEYS 16
+
+/** @brief A thread-local storage key. */
+typedef int tls_key_t;
+
+/**
+  @brief Allocate a thread-local storage key.
+
+  Each thread of the process has its own value for the key, which is 
+  initially NULL in every thread. 
+
+  When a thread exits, for each key with a non-NULL value and a destructor,
+  the value is set to NULL and the destructor is called with the old value.
+  If destructors set values again, this is repeated up to 
+  @c TLS_DESTRUCTOR_ROUNDS times.
+
+  @param destructor a function called at thread exit, or NULL
+  @returns the new key, or -1 if all @c MAX_TLS_KEYS keys are in use.
+  @see TLS_Get
+ */
+tls_key_t TLS_Alloc(void (*destructor)(void*));
+
+/** @brief The number of times thread-local destructors are repeated. */
+#define TLS_DESTRUCTOR_ROUNDS 4
+
+/**
+  @brief Release a thread-local storage key.
+
+  No destructors are called for the values of the key.
+
+  @param key the key to free
+  @returns 0 on success, or -1 if the key is not allocated.
+ */
+int TLS_Free(tls_key_t key);
+
+/**
+  @brief Return the value of a thread-local storage key for the current thread.
+
+  This is not a system call, it is executed without any locks.
+
+  @param key the key
+  @returns the value, or NULL if the value is not set or the key is not allocated.
+ */
+void* TLS_Get(tls_key_t key);
+
+/**
+  @brief Set the value of a thread-local storage key for the current thread.
+
+  This is not a system call, it is executed without any locks.
+
+  @param key the key
+  @param value the new value
+  @returns 0 on success, or -1 if the key is not allocated.
+ */
+int TLS_Set(tls_key_t key, void* value);
+
+
+/**
+  @brief Return the current time, in nanoseconds.
+
+  The time is taken from a monotonic clock. It is only meaningful in 
+  relation to other values returned by this call, e.g., to compute 
+  a deadline for @c SleepUntil.
+  */
+nsec_t GetTime();
+
+/**
+  @brief Put the current thread to sleep for an interval.
+
+  The thread is woken up close to the end of the interval, subject
+  to the precision of the host's timers. It does not wait for the end 
+  of the current quantum of its core.
+
+  @param ns the interval to sleep, in nanoseconds
+  @returns 0
+  @see SleepUntil
+  */
+int Sleep(nsec_t ns);
+
+/**
+  @brief Put the current thread to sleep until a point in time.
+
+  If the deadline has already passed, the call returns immediately.
+
+  @param deadline a time, as returned by @c GetTime, plus some interval
+  @returns 0
+  @see Sleep
+  */
+int SleepUntil(nsec_t deadline);
+
+
 
 /*******************************************
  *
@@ -458,6 +781,80 @@ int Read(Fid_t fd, char *buf, unsigned int size);
 int Write(Fid_t fd, const char* buf, unsigned int size);
 
 
+/** @brief The maximum number of buffers of @c ReadV and @c WriteV. */
+#define MAX_IOV 1024
+
+/**
+  @brief A buffer of a vectored I/O call.
+  @see ReadV
+ */
+typedef struct io_vector {
+  void* base;         /**< @brief The start of the buffer */
+  unsigned int len;   /**< @brief The size of the buffer */
+} iovec_t;
+
+/** @brief Read bytes from a stream into many buffers.
+
+  This is like @c Read, but the data is scattered into the buffers of @c iov,
+  in order, each buffer being filled before the next one is used. As with 
+  @c Read, the call blocks only if no data is available.
+
+  @param fd the file ID of the stream to read from
+  @param iov the array of buffers
+  @param iovcnt the number of buffers, at most @c MAX_IOV
+  @return the total number of bytes copied, 0 if we have reached EOF, or -1 on
+     error. Possible errors are:
+     - The file descriptor is invalid.
+     - @c iovcnt is larger than @c MAX_IOV, or the total size is larger than @c INT_MAX.
+     - There was a I/O runtime problem.
+ */
+int ReadV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt);
+
+/** @brief Write bytes to a stream from many buffers.
+
+  This is like @c Write, but the data is gathered from the buffers of @c iov,
+  in order. The data of one call is written contiguously, if the stream 
+  supports it.
+
+  @param fd the file ID of the stream to write to
+  @param iov the array of buffers
+  @param iovcnt the number of buffers, at most @c MAX_IOV
+  @return the total number of bytes copied, or -1 on error, as for @c ReadV.
+ */
+int WriteV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt);
+
+
+/** @brief Splice flag: keep moving data until @c len bytes have been moved, or the
+  input reaches EOF. */
+#define SPLICE_ALL  0x01
+
+/** @brief Move data from one stream to another.
+
+  This moves up to @c len bytes from @c fd_in to @c fd_out, inside the kernel,
+  as if by a @c Read followed by a @c Write of the same data. By default, the
+  call blocks only until some data can be read, like @c Read, and it returns 
+  after moving the data that is available. With @c SPLICE_ALL, it blocks until 
+  @c len bytes have been moved, or the input reaches EOF.
+
+  The data read is always written completely, unless the output fails. Data
+  cannot be put back into the input: if the output fails (e.g., the reader 
+  of a pipe closes it) after a chunk of up to 4096 bytes has been read, the 
+  bytes of the chunk that were not written are lost. The return value counts 
+  only the bytes written, so the caller can tell how much was moved.
+
+  @param fd_in the file ID of the stream to read from
+  @param fd_out the file ID of the stream to write to
+  @param len the maximum number of bytes to move
+  @param flags 0, or @c SPLICE_ALL
+  @return the number of bytes moved, 0 if the input reached EOF, or -1 on error.
+     Possible errors are:
+     - A file descriptor is invalid, or the input cannot be read, or the output 
+       cannot be written.
+     - There was a I/O runtime problem before any data was moved.
+ */
+int Splice(Fid_t fd_in, Fid_t fd_out, unsigned int len, int flags);
+
+
 /** @brief Close a file id.
    
 
@@ -472,6 +869,47 @@ int Write(Fid_t fd, const char* buf, unsigned int size);
 int Close(Fid_t fd);
 
 
+/** @brief Stream flag: calls on the stream do not block.
+
+  When this flag is set on a stream, @c Read, @c ReadV, @c Write, @c WriteV 
+  and @c Splice return @c STREAM_WOULDBLOCK instead of blocking, if no data 
+  can be transferred at once.
+
+  @see SetFlags
+ */
+#define STREAM_NONBLOCK  0x01
+
+/** @brief The result of a non-blocking call that would block.
+  @see STREAM_NONBLOCK
+ */
+#define STREAM_WOULDBLOCK  (-2)
+
+/** @brief Set the flags of a stream.
+
+  The flags belong to the stream, and therefore they are shared by all
+  file IDs that refer to it (see @c Dup2). The only flag is @c STREAM_NONBLOCK.
+  A typical use is
+  @code
+  SetFlags(fd, GetFlags(fd) | STREAM_NONBLOCK);
+  @endcode
+
+  @param fd the file ID of the stream
+  @param flags the new flags
+  @return 0 on success, or -1 on error. Possible errors are:
+    - The file ID is invalid.
+    - @c flags contains unknown flags.
+ */
+int SetFlags(Fid_t fd, int flags);
+
+/** @brief Get the flags of a stream.
+
+  @param fd the file ID of the stream
+  @return the flags of the stream, or -1 if the file ID is invalid.
+  @see SetFlags
+ */
+int GetFlags(Fid_t fd);
+
+
 /** @brief Make a copy of a stream to a new file ID.
 
   If @c newfd is already in use by another file, it is first
@@ -489,6 +927,128 @@ int Close(Fid_t fd);
  */
 int Dup2(Fid_t oldfd, Fid_t newfd);
 
+
+/** @brief Poll event: the stream can be read without blocking. */
+#define POLL_READ     0x01
+/** @brief Poll event: the stream can be written without blocking. */
+#define POLL_WRITE    0x02
+/** @brief Poll event (returned only): an error condition on the stream. */
+#define POLL_ERROR    0x04
+/** @brief Poll event (returned only): the other end of the stream was closed. */
+#define POLL_HANGUP   0x08
+/** @brief Poll event (returned only): the file id is not open. */
+#define POLL_INVALID  0x10
+
+/**
+  @brief A file id polled by @c Poll.
+ */
+typedef struct poll_fd {
+  Fid_t fd;         /**< @brief The file id, or a negative value to ignore this entry */
+  short events;     /**< @brief The requested events, @c POLL_READ and/or @c POLL_WRITE */
+  short revents;    /**< @brief The returned events */
+} pollfd_t;
+
+/** @brief Wait for I/O readiness on a number of streams.
+
+  For each entry of @c fds, the events of @c events that are ready are
+  stored in @c revents, together with @c POLL_ERROR, @c POLL_HANGUP or @c POLL_INVALID 
+  if they apply. If no entry has any returned events, the calling thread 
+  blocks, until some entry has, or the timeout expires.
+
+  Streams that cannot block (such as the null device) are always ready.
+
+  @param fds the array of the polled file ids
+  @param nfds the number of entries of @c fds
+  @param timeout the time to wait, in milliseconds. A timeout of 0 does not 
+     block, and a negative timeout means "infinite timeout".
+  @return the number of entries with a nonzero @c revents, which is 0 when the 
+     timeout expired, or -1 on error. Possible reasons for failure:
+  - @c fds is NULL, but @c nfds is not 0.
+  - @c nfds is larger than @c MAX_FILEID.
+ */
+int Poll(pollfd_t* fds, unsigned int nfds, timeout_t timeout);
+
+
+/** @brief Epoll flag: report a stream only when its state changes (edge-triggered). */
+#define POLL_EDGE     0x100
+/** @brief Epoll flag: report a stream once, until it is re-armed by @c EPOLL_MOD. */
+#define POLL_ONESHOT  0x200
+
+/**
+  @brief The operations of @c EpollCtl.
+ */
+typedef enum epoll_op_e {
+  EPOLL_ADD,    /**< @brief Add a file id to the interest set */
+  EPOLL_MOD,    /**< @brief Change the events of a file id, re-arming it */
+  EPOLL_DEL     /**< @brief Remove a file id from the interest set */
+} epoll_op;
+
+/**
+  @brief An event of an epoll interest set.
+ */
+typedef struct epoll_event_s {
+  int events;   /**< @brief The requested (or returned) events, with the @c POLL_EDGE and 
+                   @c POLL_ONESHOT flags */
+  void* data;   /**< @brief User data, returned with the events */
+} epoll_event_t;
+
+/** @brief Create an epoll interest set.
+
+  An interest set is a persistent set of streams, whose events are reported by 
+  @c EpollWait. Unlike @c Poll, streams notify the interest set when they may have 
+  become ready. Therefore, the cost of @c EpollWait depends on the number of 
+  ready streams, not on the size of the interest set.
+
+  By default, a stream is level-triggered: it is reported by every @c EpollWait
+  while it is ready. An edge-triggered stream (@c POLL_EDGE) is reported once, 
+  when it becomes ready. A one-shot stream (@c POLL_ONESHOT) is reported once, 
+  and then it is disabled until it is re-armed by @c EPOLL_MOD.
+
+  The interest set is closed by @c Close.
+
+  @return the file id of the interest set, or NOFILE on error. Possible reasons
+   for failure:
+   - The maximum number of file descriptors has been reached.
+ */
+Fid_t EpollCreate();
+
+/** @brief Change an epoll interest set.
+
+  The interest set holds a reference to the stream of @c fd, until it is removed. 
+  If @c fd is closed and re-opened to a different stream, @c EPOLL_ADD replaces
+  the old stream.
+
+  @param epfd the interest set
+  @param op the operation
+  @param fd the file id to add, modify or remove
+  @param event the events and user data of @c fd, ignored by @c EPOLL_DEL
+  @return 0 on success, or -1 on error. Possible reasons for failure:
+  - @c epfd is not an interest set.
+  - @c fd is not an open file id, or it is an interest set (including @c epfd).
+  - @c EPOLL_ADD was given for a file id already in the set, or @c EPOLL_MOD or
+    @c EPOLL_DEL for a file id not in the set.
+ */
+int EpollCtl(Fid_t epfd, epoll_op op, Fid_t fd, const epoll_event_t* event);
+
+/** @brief Wait for events of an epoll interest set.
+
+  This blocks until some streams of the set are ready, or the timeout expires.
+  Many threads may wait on the same interest set.
+
+  @param epfd the interest set
+  @param events an array to receive the events of the ready streams, with their
+    user data
+  @param maxevents the size of @c events, at least 1. At most @c MAX_FILEID
+    events are returned, since a set holds at most one stream per file id, so
+    a larger value is treated as @c MAX_FILEID.
+  @param timeout the time to wait, in milliseconds, as in @c Poll
+  @return the number of events stored, which is 0 when the timeout expired,
+    or -1 on error. Possible reasons for failure:
+  - @c epfd is not an interest set.
+  - @c events is NULL, or @c maxevents is 0.
+ */
+int EpollWait(Fid_t epfd, epoll_event_t* events, unsigned int maxevents, timeout_t timeout);
+
 /*******************************************
  *
  * Pipes
@@ -736,6 +1296,8 @@ typedef struct procinfo
 
     If the task's argument is longer (as designated by the @c argl field), the
     bytes contained in this field are just the prefix.  */
+
+  proc_usage usage; /**< @brief The resource usage of the process so far. */
 } procinfo;
 
 
@@ -751,7 +1313,13 @@ typedef struct procinfo
 
 	There is no guarantee of the timeliness of the information.
 	A best-effort approach to return relevant system information is
-	made. 
+	made. The stream does not take a snapshot of the process table;
+	it scans the table in pid order, and each record reflects the state
+	of its process at the time it is read.
+
+	A call to @c Read on the stream returns as many whole records as fit
+	into the buffer, and 0 when the scan is complete. A buffer smaller 
+	than @c sizeof(procinfo) is an error.
 
 	@returns a file id on success, or NOFILE on error. Possible reasons
 		for error are:
@@ -0,0 +1,344 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "tinyos.h"
+#include "tinyoslib.h"
+#include "bios.h"
+
+
+/*
+	Micro-benchmarks for the synchronization primitives of tinyos.
+
+	Each benchmark boots the VM once for each number of cores 1, 2, 4, ...
+	up to a maximum, and prints one line of results per boot.
+ */
+
+
+static double now_sec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1E-9;
+}
+
+
+/*******************************************
+ *
+ * Barrier benchmark
+ *
+ *******************************************/
+
+/*
+	The barrier that Barrier_Wait replaced, as a baseline: one mutex
+	and one condition variable for all threads.
+ */
+typedef struct {
+	Mutex mx;
+	CondVar cv;
+	unsigned int count, epoch;
+} cv_barrier;
+
+static void cv_barrier_wait(cv_barrier* bar, unsigned int n)
+{
+	Mutex_Lock(& bar->mx);
+	unsigned int epoch = bar->epoch;
+	if(++bar->count == n) {
+		bar->epoch ++;
+		bar->count = 0;
+		Cond_Broadcast(&bar->cv);
+	}
+	while(epoch == bar->epoch)
+		Cond_Wait(&bar->mx, &bar->cv);
+	Mutex_Unlock(& bar->mx);
+}
+
+
+struct barrier_bench {
+	int use_cv;				/* use the baseline barrier */
+	unsigned int threads;	/* the number of threads */
+	unsigned int phases;	/* the number of measured phases */
+	double* elapsed;		/* the result */
+
+	Barrier* bar;
+	cv_barrier* cvbar;
+};
+
+static void bench_wait(struct barrier_bench* B)
+{
+	if(B->use_cv)
+		cv_barrier_wait(B->cvbar, B->threads);
+	else
+		Barrier_Wait(B->bar);
+}
+
+static int barrier_bench_thread(int argl, void* args)
+{
+	struct barrier_bench* B = args;
+	/* One more phase, for warm-up */
+	for(unsigned int p=0; p <= B->phases; p++)
+		bench_wait(B);
+	return 0;
+}
+
+static int barrier_bench_boot(int argl, void* args)
+{
+	struct barrier_bench B = *(struct barrier_bench*)args;
+	Barrier bar;
+	cv_barrier cvbar = { MUTEX_INIT, COND_INIT, 0, 0 };
+	Barrier_Init(&bar, B.threads);
+	B.bar = &bar;
+	B.cvbar = &cvbar;
+
+	Tid_t tids[B.threads];
+	for(unsigned int i=1; i < B.threads; i++)
+		tids[i] = CreateThread(barrier_bench_thread, 0, &B);
+
+	/* Warm up: one phase to let all threads start */
+	bench_wait(&B);
+	double t0 = now_sec();
+	for(unsigned int p=0; p < B.phases; p++)
+		bench_wait(&B);
+	*B.elapsed = now_sec() - t0;
+
+	for(unsigned int i=1; i < B.threads; i++)
+		ThreadJoin(tids[i], NULL);
+	return 0;
+}
+
+static double barrier_bench_run(uint cores, int use_cv, uint threads, uint phases)
+{
+	double elapsed = 0.0;
+	struct barrier_bench B = { use_cv, threads, phases, &elapsed, NULL, NULL };
+	boot(cores, 0, barrier_bench_boot, sizeof(B), &B);
+	return phases / elapsed;
+}
+
+static int bench_barrier(uint maxcores, int argc, const char** argv)
+{
+	uint tpc = (argc > 0) ? atoi(argv[0]) : 2;
+	uint phases = (argc > 1) ? atoi(argv[1]) : 1000;
+	if(tpc == 0 || phases == 0) return -1;
+
+	printf("%6s %8s %18s %18s\n", "cores", "threads", "CondVar phases/s", "Barrier phases/s");
+	for(uint c=1; c <= maxcores; c *= 2) {
+		double cv = barrier_bench_run(c, 1, c*tpc, phases);
+		double br = barrier_bench_run(c, 0, c*tpc, phases);
+		printf("%6u %8u %18.0f %18.0f\n", c, c*tpc, cv, br);
+	}
+	return 0;
+}
+
+
+/*******************************************
+ *
+ * Context switch benchmark
+ *
+ *******************************************/
+
+/*
+	Two kernel threads take turns, via a mutex and a condition variable,
+	or two fibers take turns via Fiber_Yield. Each turn is a switch.
+ */
+struct switch_bench {
+	unsigned int rounds;	/* the number of turns of each party */
+	double thread_ns;		/* the result for kernel threads */
+	double fiber_ns;		/* the result for fibers */
+
+	Mutex mx;
+	CondVar cv;
+	unsigned int turn;
+};
+
+static int switch_bench_thread(int argl, void* args)
+{
+	struct switch_bench* B = args;
+	Mutex_Lock(& B->mx);
+	for(unsigned int r=0; r < B->rounds; r++) {
+		while((B->turn & 1) != argl)
+			Cond_Wait(& B->mx, & B->cv);
+		B->turn++;
+		Cond_Signal(& B->cv);
+	}
+	Mutex_Unlock(& B->mx);
+	return 0;
+}
+
+static int switch_bench_fiber(int argl, void* args)
+{
+	struct switch_bench* B = args;
+	for(unsigned int r=0; r < B->rounds; r++)
+		Fiber_Yield();
+	return 0;
+}
+
+static int switch_bench_fibers(int argl, void* args)
+{
+	Fiber_Create(switch_bench_fiber, 0, args);
+	return switch_bench_fiber(0, args);
+}
+
+static int switch_bench_boot(int argl, void* args)
+{
+	struct switch_bench* B = *(struct switch_bench**) args;
+	B->mx = MUTEX_INIT;
+	B->cv = COND_INIT;
+	B->turn = 0;
+
+	double t0 = now_sec();
+	Tid_t t = CreateThread(switch_bench_thread, 1, B);
+	switch_bench_thread(0, B);
+	ThreadJoin(t, NULL);
+	B->thread_ns = (now_sec() - t0) * 1E9 / (2*B->rounds);
+
+	t0 = now_sec();
+	Fiber_Run(switch_bench_fibers, 0, B);
+	B->fiber_ns = (now_sec() - t0) * 1E9 / (2*B->rounds);
+	return 0;
+}
+
+static int bench_switch(uint maxcores, int argc, const char** argv)
+{
+	uint rounds = (argc > 0) ? atoi(argv[0]) : 10000;
+	if(rounds == 0) return -1;
+
+	printf("%6s %18s %18s\n", "cores", "thread switch ns", "fiber switch ns");
+	for(uint c=1; c <= maxcores; c *= 2) {
+		struct switch_bench B = { .rounds = rounds };
+		struct switch_bench* pB = &B;
+		boot(c, 0, switch_bench_boot, sizeof(pB), &pB);
+		printf("%6u %18.1f %18.1f\n", c, B.thread_ns, B.fiber_ns);
+	}
+	return 0;
+}
+
+
+/*******************************************
+ *
+ * Fork-join benchmark
+ *
+ *******************************************/
+
+/*
+	A recursive fork-join computation (the naive Fibonacci), where each
+	fork is a new thread joined with ThreadJoin, or a task of a thread
+	pool waited with Future_Wait. Below a cutoff, the recursion is serial.
+ */
+struct forkjoin_bench {
+	unsigned int n;			/* compute fib(n) */
+	unsigned int cutoff;	/* below this, compute serially */
+	unsigned int workers;	/* the pool size */
+	double thread_us;		/* the result for threads */
+	double pool_us;			/* the result for the pool */
+	int mismatch;			/* set if the two results differ */
+
+	ThreadPool* pool;
+};
+
+static struct forkjoin_bench* fj;
+
+static int fib_serial(int n)
+{
+	return (n < 2) ? n : fib_serial(n-1) + fib_serial(n-2);
+}
+
+static int fib_threads(int n, void* unused)
+{
+	if(n < fj->cutoff) return fib_serial(n);
+	int a;
+	Tid_t t = CreateThread(fib_threads, n-1, NULL);
+	int b = fib_threads(n-2, NULL);
+	ThreadJoin(t, &a);
+	return a + b;
+}
+
+static int fib_pool(int n, void* unused)
+{
+	if(n < fj->cutoff) return fib_serial(n);
+	Future* f = Pool_Submit(fj->pool, fib_pool, n-1, NULL);
+	int b = fib_pool(n-2, NULL);
+	return Future_Wait(f) + b;
+}
+
+static int forkjoin_bench_boot(int argl, void* args)
+{
+	fj = *(struct forkjoin_bench**) args;
+
+	double t0 = now_sec();
+	int r1 = fib_threads(fj->n, NULL);
+	fj->thread_us = (now_sec() - t0) * 1E6;
+
+	fj->pool = Pool_Create(fj->workers);
+	t0 = now_sec();
+	int r2 = Future_Wait(Pool_Submit(fj->pool, fib_pool, fj->n, NULL));
+	fj->pool_us = (now_sec() - t0) * 1E6;
+	Pool_Destroy(fj->pool);
+
+	fj->mismatch = (r1 != r2);
+	return 0;
+}
+
+static int bench_forkjoin(uint maxcores, int argc, const char** argv)
+{
+	uint n = (argc > 0) ? atoi(argv[0]) : 20;
+	uint cutoff = (argc > 1) ? atoi(argv[1]) : 10;
+	if(n == 0) return -1;
+
+	printf("%6s %18s %18s\n", "cores", "threads us", "pool us");
+	for(uint c=1; c <= maxcores; c *= 2) {
+		struct forkjoin_bench B = { .n = n, .cutoff = cutoff, .workers = c };
+		struct forkjoin_bench* pB = &B;
+		boot(c, 0, forkjoin_bench_boot, sizeof(pB), &pB);
+		if(B.mismatch) {
+			fprintf(stderr, "forkjoin: the thread and pool results differ\n");
+			exit(1);
+		}
+		printf("%6u %18.0f %18.0f\n", c, B.thread_us, B.pool_us);
+	}
+	return 0;
+}
+
+
+/****************************************************/
+
+static struct {
+	const char* name;
+	int (*run)(uint maxcores, int argc, const char** argv);
+	const char* args;
+} benchmarks[] = {
+	{ "barrier", bench_barrier, "[<threads per core> [<phases>]]" },
+	{ "switch", bench_switch, "[<rounds>]" },
+	{ "forkjoin", bench_forkjoin, "[<n> [<cutoff>]]" },
+	{ NULL, NULL, NULL }
+};
+
+
+void usage(const char* pname)
+{
+	printf("usage:\n  %s <benchmark> <maxcores> [<args>...]\n\n"
+		"  runs the benchmark for 1, 2, 4, ... up to <maxcores> (at most %d) cores.\n"
+		"  The benchmarks are:\n", pname, MAX_CORES);
+	for(int i=0; benchmarks[i].name; i++)
+		printf("    %s %s\n", benchmarks[i].name, benchmarks[i].args);
+	exit(1);
+}
+
+
+int main(int argc, const char** argv)
+{
+	if(argc < 3) usage(argv[0]);
+
+	int maxcores = atoi(argv[2]);
+	if(maxcores < 1 || maxcores > MAX_CORES) usage(argv[0]);
+
+	for(int i=0; benchmarks[i].name; i++)
+		if(strcmp(argv[1], benchmarks[i].name)==0) {
+			if(benchmarks[i].run(maxcores, argc-3, argv+3))
+				usage(argv[0]);
+			return 0;
+		}
+
+	usage(argv[0]);
+	return 1;
+}
@@ -31,6 +31,7 @@ int Symposium_thr(size_t,const char**);
 int RemoteServer(size_t,const char**);
 int RemoteClient(size_t,const char**);
 int Echo(size_t,const char**);
+int Cat(size_t,const char**);
 
 
 struct { const char * cmdname; Program prog; uint nargs; const char* help; } 
@@ -54,6 +55,7 @@ COMMANDS[]  =
 	{"rserver", RemoteServer, 0, "A server for remote execution."},
 	{"rcli", RemoteClient, 1, "Remote client: rcli <cmd> [<args...>]."},
 	{"echo", Echo, 0, "echo [<args...>], send the <args...> to stdout"},
+	{"cat", Cat, 0, "Copy stdin to stdout"},
 
 	{NULL, NULL, 0, NULL}
 };
@@ -172,8 +174,8 @@ int SystemInfo(size_t argc, const char** argv)
 	if(finfo!=NOFILE) {
 		/* Print per-process info */
 		procinfo info;
-		printf("%5s %5s %6s %8s %20s\n",
-			"PID", "PPID", "State", "Threads", "Main program"
+		printf("%5s %5s %6s %8s %9s %20s\n",
+			"PID", "PPID", "State", "Threads", "CPU(ms)", "Main program"
 			);
 		/* Read in next piece of info */		
 		while(Read(finfo, (char*) &info, sizeof(info)) > 0) {
@@ -189,11 +191,12 @@ int SystemInfo(size_t argc, const char** argv)
 				if(info.pid==1) pname = "init";
 			}
 
-			printf("%5d %5d %6s %8u %20s\n",
+			printf("%5d %5d %6s %8lu %9lu %20s\n",
 				info.pid,
 				info.ppid,
 				(info.alive?"ALIVE":"ZOMBIE"),
 				info.thread_count,
+				(unsigned long)(info.usage.cpu_time / 1000000),
 				pname
 				);
 		}
@@ -278,6 +281,14 @@ int Echo(size_t argc, const char** argv)
 }
 
 
+int Cat(size_t argc, const char** argv)
+{
+	int n;
+	while((n = Splice(0, 1, 4096, 0)) > 0);
+	return (n < 0) ? 1 : 0;
+}
+
+
 int LowerCase(size_t argc, const char** argv)
 {
 	char c;
@@ -401,6 +412,30 @@ int ListPrograms(size_t argc, const char** argv)
 
 #define REMOTE_SERVER_DEFAULT_PORT 20
 
+/* The number of threads serving the connections */
+#define REMOTE_SERVER_THREADS 4
+
+/*
+  The server is event-driven: a fixed set of worker threads wait on an
+  epoll interest set, which holds the listening socket and the connections
+  whose request is still being received. All entries are one-shot, so that
+  each is served by one worker at a time, and re-armed afterwards.
+
+  When a request has been received, its process is executed, and the 
+  connection is passed to the reaper thread, which waits for the process.
+ */
+
+/* A connection */
+typedef struct rsrv_conn {
+	Fid_t sock;
+	size_t ID;
+	size_t count;		/* the number of bytes received */
+	int argl;			/* the request is [int argl, char args[argl]] */
+	char* args;
+	Pid_t pid;			/* the process executing the request */
+	rlnode node;		/* in the list of running processes */
+} rsrv_conn;
+
 /*
   The server's "global variables".
  */
@@ -411,8 +446,11 @@ struct __rs_globals
 
 	/* server related */
 	port_t port;
-	Tid_t listener;
 	Fid_t listener_socket;
+	Fid_t epoll;
+	Tid_t workers[REMOTE_SERVER_THREADS];
+	Tid_t reaper;
+	rlnode running;		/* connections whose process is running */
 
 	/* Statistics */
 	size_t active_conn;
@@ -433,42 +471,73 @@ struct __rs_globals
 #define GS(name) (((struct __rs_globals*) __globals)->name)
 
 /* forward decl */
-static int rsrv_client(int sock, void* __globals);
+static void rsrv_accept(void* __globals);
+static void rsrv_receive(void* __globals, rsrv_conn* conn);
+static int rsrv_reaper(int argl, void* __globals);
 static void log_message(void* __globals, const char* msg, ...)
 	__attribute__((format(printf,2,3)));
 static void log_init(void* __globals);
 static void log_print(void* __globals);
 static void log_truncate(void* __globals);
 
-static int rsrv_listener_thread(int port, void* __globals);
 
-/* the thread that accepts new connections */
-static int rsrv_listener_thread(int port, void* __globals)
+/* Return 1 if the workers should exit */
+static int rsrv_done(void* __globals)
 {
-	Fid_t lsock = Socket(port);
-	if(Listen(lsock) == -1) {
-		printf("Cannot listen to the given port: %d\n", port);
-		return -1;
-	}
-	GS(listener_socket) = lsock;
+	Mutex_Lock(&GS(mx));
+	int done = GS(quit) && GS(active_conn)==0;
+	Mutex_Unlock(&GS(mx));
+	return done;
+}
 
-	/* Accept loop */
-	while(1) {
-		Fid_t sock = Accept(lsock);
-		if(sock==NOFILE) {
-			/* We failed! Check if we should quit */
-			if(GS(quit)) return 0;
-			log_message(__globals, "listener(port=%d): failed to accept!\n", port);
-		} else {
-			GS(active_conn)++;
-			GS(total_conn)++;
-			Tid_t t = CreateThread(rsrv_client, sock, __globals);
-			ThreadDetach(t);
-		}
+/* a worker thread: the listener has NULL data, and connections their rsrv_conn */
+static int rsrv_worker(int argl, void* __globals)
+{
+	epoll_event_t ev;
+	while(! rsrv_done(__globals)) {
+		/* Wake up now and then, to check if we should quit */
+		if(EpollWait(GS(epoll), &ev, 1, 500) < 1) continue;
+		if(ev.data == NULL)
+			rsrv_accept(__globals);
+		else
+			rsrv_receive(__globals, ev.data);
 	}
 	return 0;
 }
 
+/* accept a new connection */
+static void rsrv_accept(void* __globals)
+{
+	Fid_t sock = Accept(GS(listener_socket));
+
+	/* Re-arm the listener */
+	epoll_event_t ev = { POLL_READ | POLL_ONESHOT, NULL };
+	EpollCtl(GS(epoll), EPOLL_MOD, GS(listener_socket), &ev);
+
+	if(sock==NOFILE) {
+		/* We failed! Check if we should quit */
+		if(! GS(quit))
+			log_message(__globals, "listener(port=%d): failed to accept!\n", GS(port));
+		return;
+	}
+
+	rsrv_conn* conn = malloc(sizeof(rsrv_conn));
+	conn->sock = sock;
+	conn->count = 0;
+	conn->args = NULL;
+
+	Mutex_Lock(&GS(mx));
+	GS(active_conn)++;
+	GS(total_conn)++;
+	conn->ID = ++GS(conn_id_counter);
+	Mutex_Unlock(&GS(mx));
+
+	log_message(__globals, "Client[%6zu]: started", conn->ID);
+
+	ev.data = conn;
+	EpollCtl(GS(epoll), EPOLL_ADD, sock, &ev);
+}
+
 
 /*  The main server process */
 int RemoteServer(size_t argc, const char** argv)
@@ -488,8 +557,20 @@ int RemoteServer(size_t argc, const char** argv)
 
 	log_init(__globals);
 
-	/* Start a thread to listen on */
-	GS(listener) = CreateThread(rsrv_listener_thread, GS(port), __globals);
+	/* Listen, and start the threads */
+	GS(listener_socket) = Socket(GS(port));
+	if(Listen(GS(listener_socket)) == -1) {
+		printf("Cannot listen to the given port: %d\n", GS(port));
+		return -1;
+	}
+	GS(epoll) = EpollCreate();
+	epoll_event_t ev = { POLL_READ | POLL_ONESHOT, NULL };
+	EpollCtl(GS(epoll), EPOLL_ADD, GS(listener_socket), &ev);
+
+	rlnode_init(& GS(running), NULL);
+	for(int i=0; i<REMOTE_SERVER_THREADS; i++)
+		GS(workers)[i] = CreateThread(rsrv_worker, i, __globals);
+	GS(reaper) = CreateThread(rsrv_reaper, 0, __globals);
 	
 	/* Enter the server console */
 	char* linebuff = NULL;
@@ -513,10 +594,13 @@ int RemoteServer(size_t argc, const char** argv)
 
 		if(strcmp(linebuff, "q\n")==0) {
 			/* Quit */
+			Mutex_Lock(&GS(mx));
 			GS(quit) = 1;
+			Cond_Broadcast(& GS(conn_done));
+			Mutex_Unlock(&GS(mx));
 			printf("Quitting\n");
+			EpollCtl(GS(epoll), EPOLL_DEL, GS(listener_socket), NULL);
 			Close(GS(listener_socket));
-			ThreadJoin(GS(listener), NULL);
 
 			Mutex_Lock(&GS(mx));
 			while(GS(active_conn)>0) {
@@ -524,6 +608,11 @@ int RemoteServer(size_t argc, const char** argv)
 				Cond_Wait(&GS(mx), &GS(conn_done));
 			}
 			Mutex_Unlock(&GS(mx));
+
+			for(int i=0; i<REMOTE_SERVER_THREADS; i++)
+				ThreadJoin(GS(workers)[i], NULL);
+			ThreadJoin(GS(reaper), NULL);
+			Close(GS(epoll));
 			
 			
 			log_truncate(__globals);
@@ -620,18 +709,6 @@ static void log_truncate(void* __globals)
 
 
 
-/* Helper to receive a message */
-static int recv_message(Fid_t sock, void* buf, size_t len)
-{
-	size_t count = 0;
-	while(count<len) {
-		int rc = Read(sock, buf+count, len-count);
-		if(rc<1) break;  /* Error or end of stream */
-		count += rc;
-	}
-	return count==len;
-}
-
 /* Helper to execute a remote process */
 static int rsrv_process(size_t argc, const char** argv)
 {
@@ -659,59 +736,109 @@ static int rsrv_process(size_t argc, const char** argv)
 	return exitstatus;
 }
 
-/* this server thread serves a remote cliend */
-static int rsrv_client(int sock, void* __globals)
+/* end a connection */
+static void rsrv_finish(void* __globals, rsrv_conn* conn)
 {
-	/* Get your client id */
+	free(conn->args);
+	free(conn);
+
 	Mutex_Lock(&GS(mx));
-	size_t ID = ++GS(conn_id_counter);
+	GS(active_conn)--;
+	Cond_Broadcast(& GS(conn_done));
 	Mutex_Unlock(&GS(mx));
+}
 
-	log_message(__globals, "Client[%6zu]: started", ID);
-	
-        /* Get the command from the client. The protocol is
-	   [int argl, void* args] where argl is the length of
-	   the subsequent message args.
-	 */
-	int argl;
-	if(! recv_message(sock, &argl, sizeof(argl))) {
+/* receive more of the request of a connection, and execute it when complete */
+static void rsrv_receive(void* __globals, rsrv_conn* conn)
+{
+	/* The protocol is [int argl, void* args] where argl is the length of
+	   the subsequent message args. */
+	int rc;
+	if(conn->count < sizeof(int))
+		rc = Read(conn->sock, (char*)&conn->argl + conn->count, sizeof(int) - conn->count);
+	else
+		rc = Read(conn->sock, conn->args + (conn->count - sizeof(int)), 
+			sizeof(int) + conn->argl - conn->count);
+
+	if(rc < 1) {
 		log_message(__globals,
-			    "Cliend[%6zu]: error in receiving request, aborting", ID);
-		goto finish;
+			    "Cliend[%6zu]: error in receiving request, aborting", conn->ID);
+		goto abort;
 	}
-		
-	assert(argl>0 && argl <= 2048);
-	{
-		char args[argl];
-		if(! recv_message(sock, args, argl)) {
+	conn->count += rc;
+
+	if(conn->count == sizeof(int)) {
+		if(conn->argl <= 0 || conn->argl > 2048) {
 			log_message(__globals,
-				    "Cliend[%6zu]: error in receiving request, aborting", ID);
-			goto finish;		
+				    "Cliend[%6zu]: bad request length %d, aborting", conn->ID, conn->argl);
+			goto abort;
 		}
-		
+		conn->args = malloc(conn->argl);
+	}
+
+	if(conn->count < sizeof(int) || conn->count < sizeof(int) + conn->argl) {
+		/* Wait for more */
+		epoll_event_t ev = { POLL_READ | POLL_ONESHOT, conn };
+		EpollCtl(GS(epoll), EPOLL_MOD, conn->sock, &ev);
+		return;
+	}
+	EpollCtl(GS(epoll), EPOLL_DEL, conn->sock, NULL);
+
+	{
 		/* Prepare to execute subprocess */
-		size_t argc = argscount(argl, args);	
+		size_t argc = argscount(conn->argl, conn->args);	
 		const char* argv[argc+2];
 		argv[0] = "rsrv_process";
 		char sock_value[32];
-		sprintf(sock_value, "%d", sock);
+		sprintf(sock_value, "%d", conn->sock);
 		argv[1] = sock_value;
-		argvunpack(argc, argv+2, argl, args);
-	
-		/* Now, execute the message in a new process */
-		int exitstatus;
-		Pid_t pid = Execute(rsrv_process, argc+2, argv);
-		Close(sock);
-		WaitChild(pid, &exitstatus);
-	
-		log_message(__globals, "Client[%6zu]: finished with status %d",
-			    ID, exitstatus);
+		argvunpack(argc, argv+2, conn->argl, conn->args);
+
+		/* Now, execute the message in a new process, and pass it to the reaper */
+		Mutex_Lock(&GS(mx));
+		conn->pid = Execute(rsrv_process, argc+2, argv);
+		Close(conn->sock);
+		rlist_push_back(& GS(running), rlnode_init(& conn->node, conn));
+		Cond_Broadcast(& GS(conn_done));
+		Mutex_Unlock(&GS(mx));
 	}
+	return;
 
-finish:
+abort:
+	EpollCtl(GS(epoll), EPOLL_DEL, conn->sock, NULL);
+	Close(conn->sock);
+	rsrv_finish(__globals, conn);
+}
+
+/* the thread that waits for the processes of the connections */
+static int rsrv_reaper(int argl, void* __globals)
+{
 	Mutex_Lock(&GS(mx));
-	GS(active_conn)--;
-	Cond_Broadcast(& GS(conn_done));
+	while(1) {
+		while(is_rlist_empty(& GS(running)) && !(GS(quit) && GS(active_conn)==0))
+			Cond_Wait(&GS(mx), &GS(conn_done));
+		if(is_rlist_empty(& GS(running))) break;
+		Mutex_Unlock(&GS(mx));
+
+		int exitstatus;
+		Pid_t pid = WaitChild(NOPROC, &exitstatus);
+
+		Mutex_Lock(&GS(mx));
+		rsrv_conn* conn = NULL;
+		for(rlnode* p = GS(running).next; p != &GS(running); p = p->next)
+			if(((rsrv_conn*) p->obj)->pid == pid) {
+				conn = p->obj;
+				rlist_remove(p);
+				break;
+			}
+		if(conn == NULL) continue;
+		Mutex_Unlock(&GS(mx));
+
+		log_message(__globals, "Client[%6zu]: finished with status %d",
+			    conn->ID, exitstatus);
+		rsrv_finish(__globals, conn);
+		Mutex_Lock(&GS(mx));
+	}
 	Mutex_Unlock(&GS(mx));
 	return 0;
 }
@@ -4,8 +4,11 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio_ext.h>
+#include <stdint.h>
+#include <ucontext.h>
 
 #include "util.h"
+#include "bios.h"
 #include "tinyos.h"
 #include "tinyoslib.h"
 
@@ -172,22 +175,719 @@ int Execute(Program prog, size_t argc, const char** argv)
 void BarrierSync(barrier* bar, unsigned int n)
 {
 	assert(n>0);
-	Mutex_Lock(& bar->mx);
+	unsigned int m = 0;
+	if(! __atomic_compare_exchange_n(& bar->B.n, &m, n, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		assert(m == n);
+	Barrier_Wait(& bar->B);
+}
+
+
+
+/*
+	Fibers.
+
+	As with kernel threads, the control block of a fiber is at the start 
+	of its memory, followed by its stack. The memory is aligned to 
+	FIBER_STACK_SIZE, so the current fiber is found from the stack pointer, 
+	without any system call.
+
+	A fiber that yields or parks switches directly to the next ready fiber.
+	The context of Fiber_Run is resumed only when no fiber is ready.
+
+	Blocking I/O is multiplexed with Poll. A fiber whose stream is not
+	ready parks in the waiting list of the scheduler. When no fiber is 
+	ready, the scheduler polls the streams of the waiting fibers, blocking
+	the thread, and moves the fibers whose streams became ready to the run 
+	queue. Fiber_Yield also polls them, without blocking, so that they do 
+	not starve while other fibers keep yielding. Each fiber polls its own 
+	stream again before the call, since the fibers woken by one poll may 
+	consume each other's data.
+ */
+
+#define FIBER_MAGIC 0xf1be7
+
+typedef struct fiber_scheduler {
+	cpu_context_t context;		/* The context of Fiber_Run */
+	rlnode ready;				/* The run queue */
+	unsigned int fibers;		/* The number of fibers which have not returned */
+	Fiber* dead;				/* A fiber which has returned, to be freed */
+	Fiber* first;				/* The fiber created by Fiber_Run */
+	int exitval;				/* The return value of the first fiber */
+
+	rlnode waiting;				/* Fibers waiting for their stream */
+	pollfd_t* pfds;				/* The poll array for the waiting fibers */
+	unsigned int pfds_size;		/* The size of pfds */
+} fiber_scheduler;
+
+struct fiber {
+	unsigned int magic;
+	fiber_scheduler* sched;
+	cpu_context_t context;
+	rlnode node;				/* In a list of the scheduler */
+
+	Task task;
+	int argl;
+	void* args;
+
+	/* The stream waited for, when in the waiting list */
+	Fid_t io_fd;
+	short io_events;
+};
+
+#define FIBER_CB_SIZE ((sizeof(Fiber) + 15) & ~(size_t)15)
+
+
+Fiber* Fiber_Self()
+{
+	char here;
+	Fiber* f = (Fiber*)((uintptr_t)&here & ~(uintptr_t)(FIBER_STACK_SIZE-1));
+	assert(f->magic == FIBER_MAGIC);
+	return f;
+}
+
+static void fiber_free(Fiber* f)
+{
+	f->magic = 0;
+	free(f);
+}
+
+/* 
+	Poll the streams of the waiting fibers, and move the fibers whose 
+	streams are ready to the run queue. Each stream is polled once.
+ */
+static void fiber_poll(fiber_scheduler* S, timeout_t timeout)
+{
+	unsigned int n = 0;
+	for(rlnode* p = S->waiting.next; p != &S->waiting; p = p->next) {
+		Fiber* f = p->obj;
+		unsigned int i = 0;
+		while(i < n && S->pfds[i].fd != f->io_fd) i++;
+		if(i == n) {
+			if(n == S->pfds_size) {
+				S->pfds_size = S->pfds_size ? 2*S->pfds_size : 16;
+				S->pfds = xrealloc(S->pfds, S->pfds_size * sizeof(pollfd_t));
+			}
+			S->pfds[n++] = (pollfd_t){ f->io_fd, 0, 0 };
+		}
+		S->pfds[i].events |= f->io_events;
+	}
+	if(n == 0) return;
+
+	if(Poll(S->pfds, n, timeout) <= 0) return;
+
+	rlnode* p = S->waiting.next;
+	while(p != &S->waiting) {
+		Fiber* f = p->obj;
+		p = p->next;
+		unsigned int i = 0;
+		while(S->pfds[i].fd != f->io_fd) i++;
+		if(S->pfds[i].revents & (f->io_events | POLL_ERROR | POLL_HANGUP | POLL_INVALID)) {
+			rlist_remove(& f->node);
+			rlist_push_back(& S->ready, & f->node);
+		}
+	}
+}
+
+/* Free the fiber which returned before we were resumed */
+static void fiber_reap(fiber_scheduler* S)
+{
+	if(S->dead) {
+		fiber_free(S->dead);
+		S->dead = NULL;
+	}
+}
+
+/* 
+	Switch from self to the next ready fiber, or to the scheduler.
+	The caller must have queued or parked self, or marked it dead.
+ */
+static void fiber_switch(Fiber* self)
+{
+	fiber_scheduler* S = self->sched;
+
+	if(is_rlist_empty(& S->ready)) {
+		cpu_swap_context(& self->context, & S->context);
+	} else {
+		Fiber* next = rlist_pop_front(& S->ready)->obj;
+		if(next == self) return;
+		cpu_swap_context(& self->context, & next->context);
+	}
+
+	/* We have been resumed */
+	fiber_reap(S);
+}
+
+static void fiber_start()
+{
+	Fiber* self = Fiber_Self();
+	fiber_scheduler* S = self->sched;
+
+	int exitval = self->task(self->argl, self->args);
+	if(self == S->first)
+		S->exitval = exitval;
+
+	S->fibers--;
+	fiber_reap(S);
+	S->dead = self;
+	fiber_switch(self);
+	assert(0);  /* Not reached */
+}
+
+static Fiber* fiber_new(fiber_scheduler* S, Task task, int argl, void* args)
+{
+	Fiber* f = aligned_alloc(FIBER_STACK_SIZE, FIBER_STACK_SIZE);
+	if(f == NULL) return NULL;
+
+	f->magic = FIBER_MAGIC;
+	f->sched = S;
+	rlnode_init(& f->node, f);
+	f->task = task;
+	f->argl = argl;
+	f->args = args;
+
+	/* 
+		Not cpu_initialize_context(), which blocks all signals in the new
+		context; a fiber runs with the signal mask of its thread.
+	 */
+	getcontext(& f->context);
+	f->context.uc_link = NULL;
+	f->context.uc_stack.ss_sp = (char*)f + FIBER_CB_SIZE;
+	f->context.uc_stack.ss_size = FIBER_STACK_SIZE - FIBER_CB_SIZE;
+	f->context.uc_stack.ss_flags = 0;
+	makecontext(& f->context, fiber_start, 0);
+
+	S->fibers++;
+	rlist_push_back(& S->ready, & f->node);
+	return f;
+}
+
+
+Fiber* Fiber_Create(Task task, int argl, void* args)
+{
+	return fiber_new(Fiber_Self()->sched, task, argl, args);
+}
+
+
+void Fiber_Yield()
+{
+	Fiber* self = Fiber_Self();
+	fiber_scheduler* S = self->sched;
+	if(! is_rlist_empty(& S->waiting))
+		fiber_poll(S, 0);
+	rlist_push_back(& S->ready, & self->node);
+	fiber_switch(self);
+}
 
-	int epoch = bar->epoch;
-	assert(bar->count < n);
 
-	bar->count ++;
-	if(bar->count == n) {
-		bar->epoch ++;
-		bar->count = 0;
-		Cond_Broadcast(&bar->cv);
+static int fiber_io(int write, Fid_t fd, char* buf, unsigned int size)
+{
+	Fiber* self = Fiber_Self();
+	fiber_scheduler* S = self->sched;
+
+	/* Park until the stream is ready */
+	pollfd_t pfd = { fd, write ? POLL_WRITE : POLL_READ, 0 };
+	while(Poll(&pfd, 1, 0) == 0) {
+		self->io_fd = fd;
+		self->io_events = pfd.events;
+		rlist_push_back(& S->waiting, & self->node);
+		fiber_switch(self);
 	}
 
-	while(epoch == bar->epoch)
-		Cond_Wait(&bar->mx, &bar->cv);
+	return write ? Write(fd, buf, size) : Read(fd, buf, size);
+}
+
+int Fiber_Read(Fid_t fd, char* buf, unsigned int size)
+{
+	return fiber_io(0, fd, buf, size);
+}
+
+int Fiber_Write(Fid_t fd, const char* buf, unsigned int size)
+{
+	return fiber_io(1, fd, (char*) buf, size);
+}
+
+
+int Fiber_Run(Task task, int argl, void* args)
+{
+	fiber_scheduler S;
+	rlnode_init(& S.ready, NULL);
+	S.fibers = 0;
+	S.dead = NULL;
+	S.exitval = 0;
+	rlnode_init(& S.waiting, NULL);
+	S.pfds = NULL;
+	S.pfds_size = 0;
+
+	S.first = fiber_new(&S, task, argl, args);
+	if(S.first == NULL) return -1;
+
+	while(S.fibers > 0) {
+		/* Wait until some fiber is ready */
+		while(is_rlist_empty(& S.ready)) {
+			assert(! is_rlist_empty(& S.waiting));
+			fiber_poll(&S, -1);
+		}
+
+		Fiber* f = rlist_pop_front(& S.ready)->obj;
+		cpu_swap_context(& S.context, & f->context);
+		fiber_reap(&S);
+	}
 
-	Mutex_Unlock(& bar->mx);
+	free(S.pfds);
+	return S.exitval;
 }
 
 
+
+/*
+	The work-stealing pool.
+
+	Each worker owns a Chase-Lev deque (Chase and Lev, "Dynamic circular 
+	work-stealing deque", SPAA 2005, with the memory orderings of Le et al., 
+	PPoPP 2013). When a deque is full, its array is replaced by one twice 
+	as large; old arrays may still be read by thieves, so they are only 
+	freed when the pool is destroyed.
+
+	A worker finds its own record via a thread-local storage key of the pool.
+	Threads outside the pool push tasks into a queue protected by the pool
+	mutex.
+
+	Idle threads sleep on the pool condition variable. Threads that make
+	work available (or complete a task) broadcast it only when there are
+	sleepers. A sleeper increments the sleeper count before it checks for
+	work, with the mutex held, so no wakeup is lost.
+ */
+
+typedef struct pool_task pool_task;
+
+struct pool_task {
+	void (*run)(pool_task* t);	/* The function executing the task */
+	ThreadPool* pool;
+	int done;					/* Set when the task has been executed */
+	rlnode node;				/* In the queue of the pool, if submitted from outside */
+};
+
+struct pool_future {
+	pool_task t;
+	Task task;
+	int argl;
+	void* args;
+	int result;
+};
+
+typedef struct deque_array {
+	long size;
+	struct deque_array* retired;	/* Older arrays, to be freed */
+	pool_task* buf[];
+} deque_array;
+
+typedef struct pool_worker {
+	ThreadPool* pool;
+	unsigned int id;
+	Tid_t tid;
+	long top, bottom;
+	deque_array* array;
+} pool_worker;
+
+struct thread_pool {
+	unsigned int nworkers;
+	tls_key_t key;				/* The key holding the pool_worker of each worker */
+
+	Mutex mx;
+	CondVar cv;
+	rlnode queue;				/* Tasks submitted from outside the pool */
+	unsigned int queued;		/* The length of queue */
+	unsigned int sleepers;		/* The number of threads sleeping on cv */
+	int shutdown;
+
+	pool_worker workers[];
+};
+
+#define DEQUE_INITIAL_SIZE 256
+
+
+static deque_array* deque_array_new(long size, deque_array* retired)
+{
+	deque_array* a = xmalloc(sizeof(deque_array) + size*sizeof(pool_task*));
+	a->size = size;
+	a->retired = retired;
+	return a;
+}
+
+/* Push a task at the bottom. Only the owner calls this. */
+static void deque_push(pool_worker* w, pool_task* t)
+{
+	long b = __atomic_load_n(& w->bottom, __ATOMIC_RELAXED);
+	long top = __atomic_load_n(& w->top, __ATOMIC_ACQUIRE);
+	deque_array* a = __atomic_load_n(& w->array, __ATOMIC_RELAXED);
+
+	if(b - top > a->size - 1) {
+		/* Grow */
+		deque_array* na = deque_array_new(2*a->size, a);
+		for(long i=top; i<b; i++)
+			na->buf[i % na->size] = a->buf[i % a->size];
+		__atomic_store_n(& w->array, na, __ATOMIC_RELEASE);
+		a = na;
+	}
+	__atomic_store_n(& a->buf[b % a->size], t, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(& w->bottom, b+1, __ATOMIC_RELAXED);
+}
+
+/* Pop a task from the bottom, or return NULL. Only the owner calls this. */
+static pool_task* deque_pop(pool_worker* w)
+{
+	long b = __atomic_load_n(& w->bottom, __ATOMIC_RELAXED) - 1;
+	deque_array* a = __atomic_load_n(& w->array, __ATOMIC_RELAXED);
+	__atomic_store_n(& w->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long top = __atomic_load_n(& w->top, __ATOMIC_RELAXED);
+
+	pool_task* t = NULL;
+	if(top <= b) {
+		t = __atomic_load_n(& a->buf[b % a->size], __ATOMIC_RELAXED);
+		if(top == b) {
+			/* The last task; race against the thieves */
+			if(! __atomic_compare_exchange_n(& w->top, &top, top+1, 0, 
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				t = NULL;
+			__atomic_store_n(& w->bottom, b+1, __ATOMIC_RELAXED);
+		}
+	} else {
+		__atomic_store_n(& w->bottom, b+1, __ATOMIC_RELAXED);
+	}
+	return t;
+}
+
+/* Steal a task from the top, or return NULL. */
+static pool_task* deque_steal(pool_worker* w)
+{
+	long top = __atomic_load_n(& w->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long b = __atomic_load_n(& w->bottom, __ATOMIC_ACQUIRE);
+	if(top >= b) return NULL;
+
+	deque_array* a = __atomic_load_n(& w->array, __ATOMIC_ACQUIRE);
+	pool_task* t = __atomic_load_n(& a->buf[top % a->size], __ATOMIC_RELAXED);
+	if(! __atomic_compare_exchange_n(& w->top, &top, top+1, 0, 
+			__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+	return t;
+}
+
+static int deque_empty(pool_worker* w)
+{
+	return __atomic_load_n(& w->top, __ATOMIC_ACQUIRE) >= __atomic_load_n(& w->bottom, __ATOMIC_ACQUIRE);
+}
+
+
+/* Return the pool_worker of the current thread, or NULL if it is not a worker of pool */
+static pool_worker* pool_self(ThreadPool* pool)
+{
+	pool_worker* w = TLS_Get(pool->key);
+	return (w != NULL && w->pool == pool) ? w : NULL;
+}
+
+/* Wake up the sleepers, if any */
+static void pool_wakeup(ThreadPool* pool)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(& pool->sleepers, __ATOMIC_RELAXED) > 0) {
+		Mutex_Lock(& pool->mx);
+		Cond_Broadcast(& pool->cv);
+		Mutex_Unlock(& pool->mx);
+	}
+}
+
+static void pool_push(ThreadPool* pool, pool_task* t)
+{
+	t->pool = pool;
+	t->done = 0;
+
+	pool_worker* w = pool_self(pool);
+	if(w != NULL)
+		deque_push(w, t);
+	else {
+		Mutex_Lock(& pool->mx);
+		rlist_push_back(& pool->queue, rlnode_init(& t->node, t));
+		__atomic_store_n(& pool->queued, pool->queued+1, __ATOMIC_RELAXED);
+		Mutex_Unlock(& pool->mx);
+	}
+	pool_wakeup(pool);
+}
+
+/* Find a task to execute: our own, then the pool queue, then a stolen one */
+static pool_task* pool_find_task(ThreadPool* pool, pool_worker* self)
+{
+	pool_task* t;
+	if(self != NULL && (t = deque_pop(self)) != NULL)
+		return t;
+
+	if(__atomic_load_n(& pool->queued, __ATOMIC_RELAXED) > 0) {
+		t = NULL;
+		Mutex_Lock(& pool->mx);
+		if(! is_rlist_empty(& pool->queue)) {
+			t = rlist_pop_front(& pool->queue)->obj;
+			__atomic_store_n(& pool->queued, pool->queued-1, __ATOMIC_RELAXED);
+		}
+		Mutex_Unlock(& pool->mx);
+		if(t) return t;
+	}
+
+	unsigned int n = pool->nworkers;
+	unsigned int start = (self != NULL) ? self->id + 1 : 0;
+	for(unsigned int i=0; i<n; i++) {
+		pool_worker* victim = & pool->workers[(start + i) % n];
+		if(victim != self && (t = deque_steal(victim)) != NULL)
+			return t;
+	}
+	return NULL;
+}
+
+static int pool_has_work(ThreadPool* pool)
+{
+	if(__atomic_load_n(& pool->queued, __ATOMIC_SEQ_CST) > 0) return 1;
+	for(unsigned int i=0; i<pool->nworkers; i++)
+		if(! deque_empty(& pool->workers[i])) return 1;
+	return 0;
+}
+
+static void pool_execute(pool_task* t)
+{
+	ThreadPool* pool = t->pool;
+	t->run(t);
+	__atomic_store_n(& t->done, 1, __ATOMIC_RELEASE);
+	pool_wakeup(pool);
+}
+
+/* 
+	Sleep until the task is done, or (for workers) there is work, or the pool 
+	is shut down. Return 1 if we should exit.
+ */
+static int pool_sleep(ThreadPool* pool, pool_worker* self, pool_task* waiting)
+{
+	int quit;
+	Mutex_Lock(& pool->mx);
+	__atomic_add_fetch(& pool->sleepers, 1, __ATOMIC_SEQ_CST);
+	while(1) {
+		if(waiting != NULL && __atomic_load_n(& waiting->done, __ATOMIC_ACQUIRE)) { quit = 0; break; }
+		if(self != NULL && pool_has_work(pool)) { quit = 0; break; }
+		if(waiting == NULL && pool->shutdown) { quit = 1; break; }
+		Cond_Wait(& pool->mx, & pool->cv);
+	}
+	__atomic_sub_fetch(& pool->sleepers, 1, __ATOMIC_SEQ_CST);
+	Mutex_Unlock(& pool->mx);
+	return quit;
+}
+
+/* 
+	Wait until t is done. A worker executes other tasks meanwhile. Other
+	threads just sleep: taking tasks from the front of the pool queue would
+	nest the oldest (largest) tasks on their stack. 
+ */
+static void pool_join(ThreadPool* pool, pool_task* t)
+{
+	pool_worker* self = pool_self(pool);
+	while(! __atomic_load_n(& t->done, __ATOMIC_ACQUIRE)) {
+		pool_task* other = (self != NULL) ? pool_find_task(pool, self) : NULL;
+		if(other != NULL)
+			pool_execute(other);
+		else
+			pool_sleep(pool, self, t);
+	}
+}
+
+static int pool_worker_main(int argl, void* args)
+{
+	pool_worker* self = args;
+	ThreadPool* pool = self->pool;
+	TLS_Set(pool->key, self);
+
+	while(1) {
+		pool_task* t = pool_find_task(pool, self);
+		if(t != NULL)
+			pool_execute(t);
+		else if(pool_sleep(pool, self, NULL))
+			break;
+	}
+	return 0;
+}
+
+
+ThreadPool* Pool_Create(unsigned int workers)
+{
+	if(workers == 0) return NULL;
+
+	ThreadPool* pool = xmalloc(sizeof(ThreadPool) + workers*sizeof(pool_worker));
+	pool->key = TLS_Alloc(NULL);
+	if(pool->key < 0) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->nworkers = workers;
+	pool->mx = MUTEX_INIT;
+	pool->cv = COND_INIT;
+	rlnode_init(& pool->queue, NULL);
+	pool->queued = 0;
+	pool->sleepers = 0;
+	pool->shutdown = 0;
+
+	for(unsigned int i=0; i<workers; i++) {
+		pool_worker* w = & pool->workers[i];
+		w->pool = pool;
+		w->id = i;
+		w->top = w->bottom = 0;
+		w->array = deque_array_new(DEQUE_INITIAL_SIZE, NULL);
+	}
+	for(unsigned int i=0; i<workers; i++)
+		pool->workers[i].tid = CreateThread(pool_worker_main, 0, & pool->workers[i]);
+
+	return pool;
+}
+
+
+void Pool_Destroy(ThreadPool* pool)
+{
+	assert(pool_self(pool) == NULL);
+
+	Mutex_Lock(& pool->mx);
+	pool->shutdown = 1;
+	Cond_Broadcast(& pool->cv);
+	Mutex_Unlock(& pool->mx);
+
+	for(unsigned int i=0; i<pool->nworkers; i++) {
+		pool_worker* w = & pool->workers[i];
+		if(w->tid != NOTHREAD)
+			ThreadJoin(w->tid, NULL);
+		deque_array* a = w->array;
+		while(a) {
+			deque_array* next = a->retired;
+			free(a);
+			a = next;
+		}
+	}
+
+	TLS_Free(pool->key);
+	free(pool);
+}
+
+
+static void future_run(pool_task* t)
+{
+	Future* f = (Future*) t;
+	f->result = f->task(f->argl, f->args);
+}
+
+Future* Pool_Submit(ThreadPool* pool, Task task, int argl, void* args)
+{
+	Future* f = xmalloc(sizeof(Future));
+	f->t.run = future_run;
+	f->task = task;
+	f->argl = argl;
+	f->args = args;
+	pool_push(pool, & f->t);
+	return f;
+}
+
+int Future_Wait(Future* f)
+{
+	pool_join(f->t.pool, & f->t);
+	int result = f->result;
+	free(f);
+	return result;
+}
+
+
+/* 
+	Parallel loops. A range is split in halves: the upper half is pushed
+	as a task, and the lower half is executed in place. Then, the upper half
+	is joined; usually it has not been stolen, and it is popped back and 
+	executed in place.
+ */
+typedef struct range_ctx {
+	ThreadPool* pool;
+	long grain;
+	size_t size;
+	const void* identity;
+	void (*for_body)(long lo, long hi, void* arg);
+	void (*body)(long lo, long hi, void* acc, void* arg);
+	void (*combine)(void* acc, const void* other, void* arg);
+	void* arg;
+} range_ctx;
+
+typedef struct range_task {
+	pool_task t;
+	range_ctx* ctx;
+	long lo, hi;
+	void* acc;
+} range_task;
+
+static void range_exec(range_ctx* C, long lo, long hi, void* acc);
+
+static void range_task_run(pool_task* t)
+{
+	range_task* r = (range_task*) t;
+	range_exec(r->ctx, r->lo, r->hi, r->acc);
+}
+
+static void range_exec(range_ctx* C, long lo, long hi, void* acc)
+{
+	if(hi - lo <= C->grain) {
+		if(C->for_body)
+			C->for_body(lo, hi, C->arg);
+		else
+			C->body(lo, hi, acc, C->arg);
+		return;
+	}
+
+	long mid = lo + (hi - lo)/2;
+	char upper_acc[C->size + 1];
+	if(C->size) memcpy(upper_acc, C->identity, C->size);
+
+	range_task upper = { .t = { .run = range_task_run }, .ctx = C, .lo = mid, .hi = hi, .acc = upper_acc };
+	pool_push(C->pool, & upper.t);
+	range_exec(C, lo, mid, acc);
+	pool_join(C->pool, & upper.t);
+
+	if(C->combine)
+		C->combine(acc, upper_acc, C->arg);
+}
+
+static void range_run(range_ctx* C, long begin, long end, long grain, void* acc)
+{
+	if(end <= begin) return;
+	if(grain <= 0) {
+		/* About 8 sub-ranges per worker */
+		grain = (end - begin) / (8 * C->pool->nworkers);
+		if(grain < 1) grain = 1;
+	}
+	C->grain = grain;
+
+	if(pool_self(C->pool) != NULL)
+		range_exec(C, begin, end, acc);
+	else {
+		/* Split the range inside the pool */
+		range_task root = { .t = { .run = range_task_run }, .ctx = C, .lo = begin, .hi = end, .acc = acc };
+		pool_push(C->pool, & root.t);
+		pool_join(C->pool, & root.t);
+	}
+}
+
+void Pool_ParallelFor(ThreadPool* pool, long begin, long end, long grain,
+	void (*body)(long lo, long hi, void* arg), void* arg)
+{
+	range_ctx C = { .pool = pool, .size = 0, .for_body = body, .arg = arg };
+	range_run(&C, begin, end, grain, NULL);
+}
+
+void Pool_ParallelReduce(ThreadPool* pool, long begin, long end, long grain,
+	size_t size, void* result, const void* identity,
+	void (*body)(long lo, long hi, void* acc, void* arg),
+	void (*combine)(void* acc, const void* other, void* arg), void* arg)
+{
+	range_ctx C = { .pool = pool, .size = size, .identity = identity, 
+		.body = body, .combine = combine, .arg = arg };
+	memcpy(result, identity, size);
+	range_run(&C, begin, end, grain, result);
+}
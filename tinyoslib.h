@@ -74,16 +74,203 @@ int ParseProcInfo(procinfo* pinfo, Program* prog, int argc, const char** argv );
 
 
 
+/**
+	@brief A statically initialized barrier.
+
+	This is a thin wrapper of @c Barrier, whose size is given at the 
+	first call to @c BarrierSync.
+ */
 typedef struct barrier {
-	Mutex mx;
-	CondVar cv;
-	unsigned int count, epoch;
+	Barrier B;
 } barrier;
 
-#define BARRIER_INIT  ((barrier){ MUTEX_INIT, COND_INIT, 0, 0})
+#define BARRIER_INIT  ((barrier){ .B = { .n = 0 } })
 
 
+/**
+	@brief Synchronize @c n threads at a barrier.
+
+	All calls on the same barrier must pass the same @c n.
+	@see Barrier_Wait
+ */
 void BarrierSync(barrier* bar, unsigned int n);
 
 
+
+/**
+	@brief The size of the memory of a fiber, including its stack.
+
+	This must be a power of 2.
+ */
+#define FIBER_STACK_SIZE (16*1024)
+
+/**
+	@brief A fiber.
+
+	Fibers are lightweight tasks, scheduled cooperatively inside a tinyos thread.
+	A fiber costs one @c FIBER_STACK_SIZE allocation, and no system calls, to
+	create. Switching between fibers does not involve the kernel scheduler.
+
+	The fibers of a thread are started by @c Fiber_Run, which returns when all
+	of them have finished. Each thread that calls @c Fiber_Run has its own run 
+	queue; fibers never move to another thread.
+
+	A fiber runs until it calls @c Fiber_Yield, or it blocks on I/O via
+	@c Fiber_Read or @c Fiber_Write, or it returns. Other blocking calls 
+	(e.g., @c Mutex_Lock or @c WaitChild) block all the fibers of the thread.
+	Blocked fibers wait together in one @c Poll call of their thread; no 
+	helper threads are created.
+ */
+typedef struct fiber Fiber;
+
+/**
+	@brief Run fibers in the current thread.
+
+	A new fiber executing @c task(argl,args) is created. Then, the fibers of the
+	thread are run, until all of them have returned.
+
+	@param task the function of the first fiber
+	@param argl passed to @c task
+	@param args passed to @c task
+	@returns the value returned by @c task
+ */
+int Fiber_Run(Task task, int argl, void* args);
+
+/**
+	@brief Create a new fiber.
+
+	The new fiber will execute @c task(argl,args), in the thread of the 
+	current fiber. The return value of @c task is ignored. This must be 
+	called by a fiber.
+
+	@returns the new fiber, or NULL if it could not be allocated
+ */
+Fiber* Fiber_Create(Task task, int argl, void* args);
+
+/**
+	@brief Return the current fiber.
+
+	This must be called by a fiber.
+ */
+Fiber* Fiber_Self();
+
+/**
+	@brief Let the other ready fibers of the thread run.
+
+	This must be called by a fiber.
+ */
+void Fiber_Yield();
+
+/**
+	@brief Read from a stream, without blocking the other fibers.
+
+	This is like @c Read. If the stream cannot be read at once (see @c Poll), 
+	the calling fiber is parked until it can; meanwhile, the other fibers of the 
+	thread run. The call may still block the thread, if another thread takes
+	the data first, or if the stream reports it is ready when it is not (e.g.,
+	a terminal is always reported as ready for writing). This must be called 
+	by a fiber.
+ */
+int Fiber_Read(Fid_t fd, char* buf, unsigned int size);
+
+/**
+	@brief Write to a stream, without blocking the other fibers.
+
+	@see Fiber_Read
+ */
+int Fiber_Write(Fid_t fd, const char* buf, unsigned int size);
+
+
+
+/**
+	@brief A work-stealing thread pool.
+
+	A pool has a fixed set of worker threads. Each worker has a deque of
+	tasks; it pushes and pops the tasks it creates at the bottom, while idle
+	workers steal tasks from the top of the other deques. Tasks submitted 
+	by threads outside the pool go through a shared queue.
+
+	A worker waiting for a task of the pool (see @c Future_Wait) executes 
+	other tasks of the pool meanwhile. Therefore, tasks may wait for tasks
+	they have submitted, without tying up workers.
+
+	A pool must be used only by the process that created it.
+ */
+typedef struct thread_pool ThreadPool;
+
+/**
+	@brief The result of a task submitted to a pool.
+	@see Pool_Submit
+ */
+typedef struct pool_future Future;
+
+/**
+	@brief Create a thread pool.
+
+	The pool uses one thread-local storage key of the process.
+
+	@param workers the number of worker threads, at least 1
+	@returns the new pool, or NULL on error
+ */
+ThreadPool* Pool_Create(unsigned int workers);
+
+/**
+	@brief Destroy a thread pool.
+
+	This waits until all submitted tasks have been executed, and then
+	joins the worker threads. It must not be called by a worker.
+ */
+void Pool_Destroy(ThreadPool* pool);
+
+/**
+	@brief Submit a task to a pool.
+
+	The task executes @c task(argl,args) in some worker. Its return value is 
+	obtained by @c Future_Wait, which must be called exactly once for each 
+	future.
+
+	@returns the future of the task
+ */
+Future* Pool_Submit(ThreadPool* pool, Task task, int argl, void* args);
+
+/**
+	@brief Wait for a task and release its future.
+
+	@returns the value returned by the task
+ */
+int Future_Wait(Future* future);
+
+/**
+	@brief Execute a loop in parallel.
+
+	The range <tt>[begin,end)</tt> is split recursively in halves, down to
+	sub-ranges of at most @c grain iterations, and @c body(lo,hi,arg) is called 
+	for each sub-range, in parallel. 
+
+	@param grain the maximum size of a sub-range, or 0 to pick one 
+	   automatically
+ */
+void Pool_ParallelFor(ThreadPool* pool, long begin, long end, long grain,
+	void (*body)(long lo, long hi, void* arg), void* arg);
+
+/**
+	@brief Compute a reduction in parallel.
+
+	The range is split as in @c Pool_ParallelFor. For each sub-range, an accumulator 
+	of @c size bytes is initialized from @c identity, and @c body(lo,hi,acc,arg) 
+	accumulates the sub-range into it. Accumulators are then merged by 
+	@c combine(acc,other,arg), which adds @c other into @c acc. Sub-ranges are 
+	always combined in order, so @c combine needs to be associative, but not
+	commutative. The final value is stored into @c result.
+
+	@param size the size of an accumulator
+	@param result the location of the result, of @c size bytes
+	@param identity the initial value of an accumulator
+ */
+void Pool_ParallelReduce(ThreadPool* pool, long begin, long end, long grain,
+	size_t size, void* result, const void* identity,
+	void (*body)(long lo, long hi, void* acc, void* arg),
+	void (*combine)(void* acc, const void* other, void* arg), void* arg);
+
+
 #endif
@@ -118,6 +118,21 @@ static inline void * xmalloc (size_t size)
   return value;
 }
 
+/**
+	@brief A wrapper for realloc checking for out-of-memory.
+
+	@param ptr the memory block to resize, or NULL
+	@param size the new size of the block
+	@returns the resized memory block
+  */
+static inline void * xrealloc (void* ptr, size_t size)
+{
+  void *value = realloc (ptr, size);
+  if (value == 0)
+    FATAL("virtual memory exhausted");
+  return value;
+}
+
 
 /** @}   check_macros  */
 
@@ -647,9 +662,60 @@ static inline size_t argscount(int argl, void* args)
 	return n;	
 }
 
+/**
+	@brief A read-only view of the strings packed in an argument buffer.
+
+	A view does not copy the buffer; the strings it returns point into it,
+	so they change if the buffer is modified.
+
+	A typical loop over the strings of a buffer is
+	@code
+	argview v = argview_init(argl, args);
+	const char* s;
+	while((s = argview_next(&v)) != NULL) {
+		...
+	}
+	@endcode
+	@see argview_init
+*/
+typedef struct argview {
+	const char* pos;	/**< @brief The next string */
+	const char* end;	/**< @brief The end of the buffer */
+} argview;
+
+/**
+	@brief Create a view of an argument buffer.
+
+	@param argl the length of the argument buffer
+	@param args the argument buffer
+	@returns a view positioned at the first string of @c args
+*/
+static inline argview argview_init(int argl, const void* args)
+{
+	argview v = { args, (const char*)args + argl };
+	return v;
+}
+
+/**
+	@brief Return the next string of a view.
+
+	@param v the view
+	@returns the next string, or NULL if there are no more strings
+*/
+static inline const char* argview_next(argview* v)
+{
+	if(v->pos >= v->end) return NULL;
+	const char* s = v->pos;
+	const char* z = memchr(s, 0, v->end - s);
+	v->pos = (z != NULL) ? z+1 : v->end;
+	return s;
+}
+
 /**
 	@brief Unpack a string array from an argument buffer.
 
+	No strings are copied; the elements of @c argv point into @c args.
+
 	The string array's length must be less than or equal to
 	the number of zero bytes in @c args.
 
@@ -663,12 +729,10 @@ static inline size_t argscount(int argl, void* args)
 */
 static inline void* argvunpack(size_t argc, const char** argv, int argl, void* args)
 {
-	char* a = args;
-	for(int i=0;i<argc;i++) {
-		argv[i] = a;
-		while(*a++); /* skip non-0 */
-	}
-	return a;
+	argview v = argview_init(argl, args);
+	for(size_t i=0;i<argc;i++)
+		argv[i] = argview_next(&v);
+	return (void*) v.pos;
 }
 
 
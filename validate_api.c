@@ -9,6 +9,7 @@
 #include "util.h"
 #include "symposium.h"
 #include "tinyoslib.h"
+#include "kernel_cc.h"
 #include "unit_testing.h"
 
 
@@ -2597,11 +2598,1344 @@ BARE_TEST(dummy_user_test,
 }
 
 
+struct broadcast_chain_args {
+	Mutex* m;
+	CondVar* cv;
+	int* ready;
+	int* woken;
+	timeout_t timeout;
+};
+
+static int broadcast_chain_waiter(int argl, void* args)
+{
+	struct broadcast_chain_args* A = args;
+	int ret;
+	Mutex_Lock(A->m);
+	(* A->ready)++;
+	if(A->timeout)
+		ret = Cond_TimedWait(A->m, A->cv, A->timeout);
+	else
+		ret = Cond_Wait(A->m, A->cv);
+	(* A->woken) += ret;
+	Mutex_Unlock(A->m);
+	return ret;
+}
+
+BOOT_TEST(test_cond_broadcast_chain,
+	"Test that a broadcast wakes up every waiter, even when some waiters of the\n"
+	"broadcast have already woken up because of a timeout."
+	)
+{
+	Mutex m = MUTEX_INIT;
+	CondVar cv = COND_INIT;
+	CondVar never = COND_INIT;
+	int ready = 0, woken = 0;
+	const int N = 20;
+
+	struct broadcast_chain_args forever = { &m, &cv, &ready, &woken, 0 };
+	struct broadcast_chain_args shortwait = { &m, &cv, &ready, &woken, 20 };
+
+	Tid_t tids[N];
+	for(int i=0; i<N; i++)
+		tids[i] = CreateThread(broadcast_chain_waiter, 0, (i%2) ? &shortwait : &forever);
+
+	Mutex_Lock(&m);
+	while(ready < N) 
+		Cond_TimedWait(&m, &never, 10);
+	/* Let the short waits expire */
+	Cond_TimedWait(&m, &never, 100);
+	Cond_Broadcast(&cv);
+	Mutex_Unlock(&m);
+
+	for(int i=0; i<N; i++) {
+		int exitval;
+		ASSERT(ThreadJoin(tids[i], &exitval)==0);
+		if(i%2==0) ASSERT(exitval==1);
+	}
+	ASSERT(woken >= N/2);
+	return 0;
+}
+
+
+struct barrier_phases_args {
+	Barrier* bar;
+	unsigned int* count;
+	unsigned int* serial;
+	unsigned int N, phases;
+};
+
+static int barrier_phases_thread(int argl, void* args)
+{
+	struct barrier_phases_args* A = args;
+	for(unsigned int p=0; p<A->phases; p++) {
+		__atomic_add_fetch(A->count, 1, __ATOMIC_SEQ_CST);
+		if(Barrier_Wait(A->bar))
+			__atomic_add_fetch(A->serial, 1, __ATOMIC_SEQ_CST);
+		ASSERT(__atomic_load_n(A->count, __ATOMIC_SEQ_CST) == A->N*(p+1));
+		if(Barrier_Wait(A->bar))
+			__atomic_add_fetch(A->serial, 1, __ATOMIC_SEQ_CST);
+	}
+	return 0;
+}
+
+BOOT_TEST(test_barrier_phases,
+	"Test that no thread passes a barrier before all threads have arrived, over\n"
+	"many phases, and that exactly one thread completes each phase."
+	)
+{
+	const unsigned int N = 10, PHASES = 50;
+	Barrier bar;
+	unsigned int count = 0, serial = 0;
+	Barrier_Init(&bar, N);
+
+	struct barrier_phases_args A = { &bar, &count, &serial, N, PHASES };
+	Tid_t tids[N-1];
+	for(unsigned int i=0; i<N-1; i++)
+		tids[i] = CreateThread(barrier_phases_thread, 0, &A);
+	barrier_phases_thread(0, &A);
+
+	for(unsigned int i=0; i<N-1; i++)
+		ASSERT(ThreadJoin(tids[i], NULL)==0);
+	ASSERT(count == N*PHASES);
+	ASSERT(serial == 2*PHASES);
+	return 0;
+}
+
+
+static int read_until_closed(int argl, void* args)
+{
+	Fid_t fid = argl;
+	char buf[16];
+	int reads = 0;
+	int rc;
+	while((rc = Read(fid, buf, sizeof(buf))) == sizeof(buf))
+		reads++;
+	ASSERT(rc == -1);
+	return reads;
+}
+
+BOOT_TEST(test_read_races_close,
+	"Test that Read, which runs without the kernel lock, sees either the open\n"
+	"stream or a closed fid, when the fid is closed concurrently."
+	)
+{
+	const int N = 8;
+	Fid_t fids[N];
+	Tid_t tids[N];
+	for(int i=0; i<N; i++) {
+		fids[i] = OpenNull();
+		ASSERT(fids[i] != NOFILE);
+		tids[i] = CreateThread(read_until_closed, fids[i], NULL);
+	}
+	fibo(20);
+	for(int i=0; i<N; i++)
+		ASSERT(Close(fids[i]) == 0);
+	for(int i=0; i<N; i++)
+		ASSERT(ThreadJoin(tids[i], NULL) == 0);
+
+	/* The fids can be reused */
+	for(int i=0; i<N; i++)
+		ASSERT(OpenNull() != NOFILE);
+	return 0;
+}
+
+
+BOOT_TEST(test_sleep_deadlines,
+	"Test that Sleep, SleepUntil and Cond_TimedWaitNs do not return before their\n"
+	"deadline, and that they do not wait for the quantum to expire."
+	)
+{
+	const nsec_t MSEC = 1000000;
+	nsec_t total = 0;
+	for(int i=0; i<10; i++) {
+		nsec_t t0 = GetTime();
+		ASSERT(Sleep(MSEC) == 0);
+		nsec_t dt = GetTime() - t0;
+		ASSERT(dt >= MSEC);
+		total += dt;
+	}
+	/* On average, much less than a quantum (10 msec) late */
+	ASSERT(total < 10*5*MSEC);
+
+	nsec_t deadline = GetTime() + 3*MSEC;
+	ASSERT(SleepUntil(deadline) == 0);
+	ASSERT(GetTime() >= deadline);
+	ASSERT(SleepUntil(deadline) == 0);
+
+	Mutex mx = MUTEX_INIT;
+	CondVar cv = COND_INIT;
+	Mutex_Lock(&mx);
+	nsec_t t0 = GetTime();
+	ASSERT(Cond_TimedWaitNs(&mx, &cv, 2*MSEC) == 0);
+	ASSERT(GetTime() - t0 >= 2*MSEC);
+	Mutex_Unlock(&mx);
+	return 0;
+}
+
+
+static int return_zero(int argl, void* args) { return 0; }
+
+BOOT_TEST(test_pid_no_immediate_reuse,
+	"Test that the process table grows to hold many live processes, and that\n"
+	"the PID of a reaped child is not handed out again right away."
+	)
+{
+	/* Zombies keep their PIDs until they are reaped */
+	enum { N = 1000 };
+	Pid_t pids[N];
+	for(int i=0; i<N; i++) {
+		pids[i] = Exec(return_zero, 0, NULL);
+		ASSERT(pids[i] != NOPROC);
+		for(int j=0; j<i; j++) ASSERT(pids[i] != pids[j]);
+	}
+	for(int i=0; i<N; i++)
+		ASSERT(WaitChild(pids[i], NULL) == pids[i]);
+
+	Pid_t last = Exec(return_zero, 0, NULL);
+	ASSERT(WaitChild(last, NULL) == last);
+	for(int i=0; i<16; i++) {
+		Pid_t pid = Exec(return_zero, 0, NULL);
+		ASSERT(pid != last);
+		ASSERT(WaitChild(pid, NULL) == pid);
+		last = pid;
+	}
+	return 0;
+}
+
+
+static int wait_for_barrier(int argl, void* args)
+{
+	BarrierSync(*(barrier**) args, 2);
+	return 0;
+}
+
+BOOT_TEST(test_procinfo_stream,
+	"Test that OpenInfo returns a record for every live and zombie process,\n"
+	"several records per Read."
+	)
+{
+	barrier bar = BARRIER_INIT;
+	barrier* pbar = &bar;
+	Pid_t alive = Exec(wait_for_barrier, sizeof(pbar), &pbar);
+	Pid_t zombie = Exec(return_zero, 4, "abc");
+	while(1) {
+		/* Wait for the zombie */
+		Fid_t f = OpenInfo();
+		ASSERT(f != NOFILE);
+		procinfo info[8];
+		int found = 0, zombie_found = 0, nrec = 0, n;
+		ASSERT(Read(f, (char*)info, sizeof(procinfo)-1) == -1);
+		while((n = Read(f, (char*)info, sizeof(info))) > 0) {
+			ASSERT(n % sizeof(procinfo) == 0);
+			for(int i=0; i < n/sizeof(procinfo); i++, nrec++) {
+				if(info[i].pid == 1) { 
+					ASSERT(info[i].alive && info[i].thread_count == 1); found++; 
+				}
+				if(info[i].pid == alive) { 
+					ASSERT(info[i].ppid == 1 && info[i].main_task == wait_for_barrier);
+					ASSERT(info[i].argl == sizeof(pbar));
+					ASSERT(memcmp(info[i].args, &pbar, sizeof(pbar)) == 0);
+					found++; 
+				}
+				if(info[i].pid == zombie) {
+					ASSERT(info[i].argl == 4);
+					zombie_found = !info[i].alive;
+					found++;
+				}
+			}
+		}
+		ASSERT(n == 0);
+		ASSERT(Close(f) == 0);
+		/* pid 0, 1 and the two children */
+		ASSERT(nrec == 4);
+		ASSERT(found == 3);
+		if(zombie_found) break;
+		Sleep(1000000);
+	}
+
+	BarrierSync(&bar, 2);
+	ASSERT(WaitChild(alive, NULL) == alive);
+	ASSERT(WaitChild(zombie, NULL) == zombie);
+	return 0;
+}
+
+
+BOOT_TEST(test_stale_tids_rejected,
+	"Test that thread ids of joined threads are rejected, even after their\n"
+	"slot in the thread table has been reused."
+	)
+{
+	enum { N = 1000 };
+	Tid_t tids[N];
+	for(int i=0; i<N; i++) {
+		tids[i] = CreateThread(return_zero, 0, NULL);
+		ASSERT(tids[i] != NOTHREAD);
+	}
+	for(int i=N-1; i>=0; i--) {
+		int exitval = -1;
+		ASSERT(ThreadJoin(tids[i], &exitval) == 0);
+		ASSERT(exitval == 0);
+	}
+
+	/* These reuse the slots of the joined threads */
+	Tid_t again[N];
+	for(int i=0; i<N; i++) {
+		again[i] = CreateThread(return_zero, 0, NULL);
+		ASSERT(again[i] != NOTHREAD);
+	}
+	for(int i=0; i<N; i++) {
+		ASSERT(ThreadJoin(tids[i], NULL) == -1);
+		ASSERT(ThreadDetach(tids[i]) == -1);
+	}
+	for(int i=0; i<N; i++)
+		ASSERT(ThreadJoin(again[i], NULL) == 0);
+
+	ASSERT(ThreadJoin(NOTHREAD, NULL) == -1);
+	ASSERT(ThreadJoin(ThreadSelf(), NULL) == -1);
+	return 0;
+}
+
+
+static int check_shared_args(int argl, void* args)
+{
+	return (argl == sizeof(int)) ? *(int*)args : -1;
+}
+
+BOOT_TEST(test_execmany,
+	"Test that ExecMany creates children with the right arguments, like\n"
+	"as many calls to Exec."
+	)
+{
+	enum { N = 100 };
+	int vals[N];
+	void* argp[N];
+	Pid_t pids[N];
+	for(int i=0; i<N; i++) {
+		vals[i] = i/10;   /* runs of equal arguments */
+		argp[i] = (i%3==0) ? &vals[i-i%10] : &vals[i];
+	}
+
+	ASSERT(ExecMany(check_shared_args, 0, sizeof(int), argp, pids) == -1);
+	ASSERT(ExecMany(check_shared_args, MAX_PROC+1, sizeof(int), argp, pids) == -1);
+	ASSERT(ExecMany(check_shared_args, (unsigned int)-1, sizeof(int), argp, pids) == -1);
+	ASSERT(ExecMany(check_shared_args, N, sizeof(int), argp, pids) == N);
+	for(int i=0; i<N; i++) {
+		ASSERT(pids[i] != NOPROC);
+		int status;
+		ASSERT(WaitChild(pids[i], &status) == pids[i]);
+		ASSERT(status == i/10);
+	}
+
+	/* No arguments */
+	ASSERT(ExecMany(check_shared_args, N, 0, NULL, pids) == N);
+	for(int i=0; i<N; i++) {
+		int status;
+		ASSERT(WaitChild(pids[i], &status) == pids[i]);
+		ASSERT(status == -1);
+	}
+	ASSERT(WaitChild(NOPROC, NULL) == NOPROC);
+	return 0;
+}
+
+
+static int return_argl(int argl, void* args) { return argl; }
+
+static int wait_for_child_thread(int argl, void* args)
+{
+	int status;
+	ASSERT(WaitChild(argl, &status) == argl);
+	ASSERT(status == 7);
+	return 0;
+}
+
+BOOT_TEST(test_waitchildren,
+	"Test that WaitChildren reaps many children at once, and that threads waiting\n"
+	"for specific children are woken up."
+	)
+{
+	enum { N = 50 };
+	Pid_t pids[N], reaped[N];
+	int status[N];
+	for(int i=0; i<N; i++)
+		pids[i] = Exec(return_argl, i, NULL);
+
+	/* Let them all exit, then reap them in bulk */
+	Sleep(20000000);
+	int total = 0, n;
+	while((n = WaitChildren(reaped, status, N)) > 0) {
+		for(int i=0; i<n; i++)
+			ASSERT(pids[status[i]] == reaped[i]);
+		total += n;
+	}
+	ASSERT(total == N);
+	ASSERT(WaitChild(NOPROC, NULL) == NOPROC);
+
+	/* Threads waiting for specific children */
+	Tid_t tids[N];
+	for(int i=0; i<N; i++) {
+		pids[i] = Exec(return_argl, 7, NULL);
+		tids[i] = CreateThread(wait_for_child_thread, pids[i], NULL);
+	}
+	for(int i=0; i<N; i++)
+		ASSERT(ThreadJoin(tids[i], NULL) == 0);
+	ASSERT(WaitChildren(NULL, NULL, N) == 0);
+	return 0;
+}
+
+
+static int sleep_and_return(int argl, void* args)
+{
+	Sleep(20000000);
+	return argl;
+}
+
+static int wait_child_result(int argl, void* args)
+{
+	int status = 0;
+	Pid_t pid = WaitChild(argl, &status);
+	ASSERT(pid == NOPROC || status == 7);
+	return pid == argl;
+}
+
+BOOT_TEST(test_waitchild_many_waiters,
+	"Test that several threads can wait for the same child, and that exactly\n"
+	"one of them gets its exit status."
+	)
+{
+	Pid_t pid = Exec(sleep_and_return, 7, NULL);
+	Tid_t t1 = CreateThread(wait_child_result, pid, NULL);
+	Tid_t t2 = CreateThread(wait_child_result, pid, NULL);
+	int r1, r2;
+	ASSERT(ThreadJoin(t1, &r1) == 0);
+	ASSERT(ThreadJoin(t2, &r2) == 0);
+	ASSERT(r1 + r2 == 1);
+	ASSERT(WaitChild(pid, NULL) == NOPROC);
+	ASSERT(WaitChild(NOPROC, NULL) == NOPROC);
+	return 0;
+}
+
+
+static int usage_thread(int argl, void* args)
+{
+	BarrierSync((barrier*) args, 4);
+	return 0;
+}
+
+static int usage_child(int argl, void* args)
+{
+	char buf[1000];
+	Fid_t f = OpenNull();
+	ASSERT(Write(f, buf, 1000) == 1000);
+	ASSERT(Read(f, buf, 500) == 500);
+	Close(f);
+
+	barrier bar = BARRIER_INIT;
+	Tid_t t[3];
+	for(int i=0; i<3; i++) t[i] = CreateThread(usage_thread, 0, &bar);
+	BarrierSync(&bar, 4);
+	for(int i=0; i<3; i++) ThreadJoin(t[i], NULL);
+
+	/* Burn some CPU */
+	nsec_t t0 = GetTime();
+	while(GetTime() - t0 < 20000000);
+	return 0;
+}
+
+BOOT_TEST(test_process_usage,
+	"Test that WaitChildUsage and OpenInfo report the resource usage of a process."
+	)
+{
+	proc_usage u;
+	Pid_t child = Exec(usage_child, 0, NULL);
+	ASSERT(WaitChildUsage(child, NULL, &u) == child);
+	ASSERT(u.bytes_written == 1000);
+	ASSERT(u.bytes_read == 500);
+	ASSERT(u.peak_threads == 4);
+	ASSERT(u.peak_stack >= 4*u.peak_threads);
+	ASSERT(u.peak_heap >= 4*sizeof(void*));
+	ASSERT(u.cpu_time >= 10000000);
+	ASSERT(u.cpu_time < 1000000000);
+	ASSERT(u.ctx_switches > 0);
+
+	/* My own usage, via OpenInfo */
+	Fid_t f = OpenInfo();
+	procinfo info;
+	while(Read(f, (char*)&info, sizeof(info)) > 0)
+		if(info.pid == GetPid()) break;
+	ASSERT(info.pid == GetPid());
+	ASSERT(info.usage.peak_threads == 1);
+	ASSERT(info.usage.bytes_read >= sizeof(info));
+	Close(f);
+	return 0;
+}
+
+
+static int args_address(int argl, void* args)
+{
+	return (int)((uintptr_t)args & 0x7fffffff);
+}
+
+static int scribble_args(int argl, void* args)
+{
+	char c = ((char*)args)[0];
+	((char*)args)[0] = 'x';
+	return c;
+}
+
+static int relay_args(int argl, void* args)
+{
+	int status;
+	WaitChild(Exec(args_address, argl, args), &status);
+	return status != args_address(argl, args);
+}
+
+BOOT_TEST(test_exec_private_args,
+	"Test that Exec gives each child a private copy of its arguments, even when\n"
+	"they are equal to those of a sibling, or to those of the parent."
+	)
+{
+	char buf[256] = "hello";
+	int s1, s2;
+
+	/* Equal arguments are copied for each child */
+	Pid_t p1 = Exec(scribble_args, sizeof(buf), buf);
+	Pid_t p2 = Exec(scribble_args, sizeof(buf), buf);
+	WaitChild(p1, &s1);
+	WaitChild(p2, &s2);
+	ASSERT(s1 == 'h' && s2 == 'h');
+	ASSERT(buf[0] == 'h');
+
+	/* A child passing its own arguments to a grandchild copies them */
+	WaitChild(Exec(relay_args, sizeof(buf), buf), &s1);
+	ASSERT(s1 == 1);
+	return 0;
+}
+
+
+static int sleep_forever(int argl, void* args)
+{
+	Sleep(1000*1000000000ul);
+	return 0;
+}
+
+static int join_forever(int argl, void* args)
+{
+	ThreadJoin(CreateThread(sleep_forever, 0, NULL), NULL);
+	return 0;
+}
+
+static int wait_forever(int argl, void* args)
+{
+	Exec(sleep_forever, 0, NULL);
+	while(WaitChild(NOPROC, NULL) != NOPROC);
+	return 0;
+}
+
+/* Take many short naps before sleeping for ever, so that a kill may land just before a sleep */
+static int nap_then_sleep(int argl, void* args)
+{
+	for(int i=0; i<argl; i++)
+		Sleep(1000);
+	return sleep_forever(0, NULL);
+}
+
+static int sleep_again(int argl, void* args)
+{
+	for(int i=0; i<16; i++)
+		CreateThread(nap_then_sleep, 1000*i, NULL);
+	return nap_then_sleep(100000, NULL);
+}
+
+static int job_leader(int argl, void* args)
+{
+	SetPgid(NOPROC, NOPROC);
+	Exec(sleep_forever, 0, NULL);
+	Exec(sleep_again, 0, NULL);
+	Exec(join_forever, 0, NULL);
+	Exec(wait_forever, 0, NULL);
+	BarrierSync(*(barrier**) args, 2);
+	while(WaitChild(NOPROC, NULL) != NOPROC);
+	return 0;
+}
+
+BOOT_TEST(test_kill_group,
+	"Test that KillGroup terminates a process group whose members are blocked\n"
+	"in various ways, and that WaitGroup waits until the group is reaped."
+	)
+{
+	barrier bar = BARRIER_INIT;
+	barrier* pbar = &bar;
+	Pid_t job = Exec(job_leader, sizeof(pbar), &pbar);
+	BarrierSync(&bar, 2);
+
+	ASSERT(GetPgid(job) == job);
+	ASSERT(GetPgid(NOPROC) != job);
+	ASSERT(SetPgid(NOPROC, NOPROC) == -1);
+	ASSERT(SetPgid(job, GetPid()+1000) == -1);
+	ASSERT(KillGroup(GetPid()+1000, 0) == -1);
+
+	ASSERT(KillGroup(job, 42) >= 5);
+
+	/* Nobody sleeps until the end of its Sleep */
+	nsec_t t0 = GetTime();
+	int status;
+	ASSERT(WaitChild(job, &status) == job);
+	ASSERT(status == 42);
+	ASSERT(WaitGroup(job) >= 0);
+	ASSERT(GetTime() - t0 < 10000000000ul);
+
+	/* The group is gone */
+	ASSERT(WaitGroup(job) == -1);
+	ASSERT(KillGroup(job, 0) == -1);
+	ASSERT(WaitChild(NOPROC, NULL) == NOPROC);
+	return 0;
+}
+
+
+static Mutex killed_mx = MUTEX_INIT;
+static CondVar killed_cv = COND_INIT;
+static barrier killed_bar;
+
+static int read_forever(int argl, void* args)
+{
+	char c;
+	Read(argl, &c, 1);
+	return 0;
+}
+
+static int park_forever(int argl, void* args)
+{
+	BarrierSync((barrier*) args, 3);
+	return 0;
+}
+
+static int cond_wait_forever(int argl, void* args)
+{
+	Mutex_Lock(&killed_mx);
+	for(;;) Cond_Wait(&killed_mx, &killed_cv);
+	Mutex_Unlock(&killed_mx);
+	return 0;
+}
+
+static int blocked_io_leader(int argl, void* args)
+{
+	SetPgid(NOPROC, NOPROC);
+	CreateThread(park_forever, 0, &killed_bar);
+	CreateThread(park_forever, 0, &killed_bar);
+	CreateThread(cond_wait_forever, 0, NULL);
+	return read_forever(argl, NULL);
+}
+
+BOOT_TEST(test_kill_blocked_io,
+	"Test that KillGroup terminates the members of a group that are blocked\n"
+	"in a terminal Read, in Barrier_Wait and in Cond_Wait.",
+	.minimum_terminals = 1
+	)
+{
+	killed_bar = BARRIER_INIT;
+	Fid_t term = OpenTerminal(0);
+	Pid_t job = Exec(blocked_io_leader, term, NULL);
+	Sleep(20000000);
+
+	ASSERT(KillGroup(job, 42) == 1);
+	ASSERT(WaitGroup(job) == 1);
+	ASSERT(WaitGroup(job) == -1);
+	ASSERT(WaitChild(NOPROC, NULL) == NOPROC);
+
+	/* The terminal still works */
+	sendme(0, "x");
+	checked_read(term, "x");
+	return 0;
+}
+
+
+static void tls_count_destructor(void* value)
+{
+	__atomic_add_fetch((int*) value, 1, __ATOMIC_RELAXED);
+}
+
+static tls_key_t tls_key;
+
+static int tls_thread(int argl, void* args)
+{
+	int* counter = args;
+	ASSERT(TLS_Get(tls_key) == NULL);
+	ASSERT(TLS_Set(tls_key, counter) == 0);
+	Sleep(1000);
+	ASSERT(TLS_Get(tls_key) == counter);
+	return 0;
+}
+
+BOOT_TEST(test_tls,
+	"Test that thread-local values are separate for each thread, and that\n"
+	"their destructors are called at thread exit."
+	)
+{
+	enum { N = 8 };
+	int counter[N] = { 0 };
+
+	tls_key = TLS_Alloc(tls_count_destructor);
+	ASSERT(tls_key >= 0);
+	ASSERT(TLS_Set(tls_key, &counter) == 0);
+
+	Tid_t tids[N];
+	for(int i=0; i<N; i++)
+		tids[i] = CreateThread(tls_thread, 0, &counter[i]);
+	for(int i=0; i<N; i++)
+		ASSERT(ThreadJoin(tids[i], NULL) == 0);
+
+	/* Each destructor was called once, with the value of its thread */
+	for(int i=0; i<N; i++)
+		ASSERT(counter[i] == 1);
+	ASSERT(TLS_Get(tls_key) == &counter);
+
+	/* A freed key has no values, and a reallocated key starts as NULL */
+	ASSERT(TLS_Free(tls_key) == 0);
+	ASSERT(TLS_Free(tls_key) == -1);
+	ASSERT(TLS_Get(tls_key) == NULL);
+	ASSERT(TLS_Set(tls_key, &counter) == -1);
+	tls_key_t key2 = TLS_Alloc(NULL);
+	ASSERT(key2 == tls_key);
+	ASSERT(TLS_Get(key2) == NULL);
+
+	/* Running out of keys */
+	for(int i=1; i<MAX_TLS_KEYS; i++)
+		ASSERT(TLS_Alloc(NULL) >= 0);
+	ASSERT(TLS_Alloc(NULL) == -1);
+	return 0;
+}
+
+
+struct fiber_test {
+	int next;		/* the fiber expected to run next */
+	int errors;
+	int io_done;
+	Fid_t null;
+};
+
+static int fiber_counter(int argl, void* args)
+{
+	struct fiber_test* T = args;
+	/* The fibers run round-robin */
+	for(int r=0; r<10; r++) {
+		if(T->next != argl) T->errors++;
+		T->next = (argl+1) % 100;
+		Fiber_Yield();
+	}
+	return 0;
+}
+
+static int fiber_reader(int argl, void* args)
+{
+	struct fiber_test* T = args;
+	char buf[16];
+	for(int r=0; r<10; r++) {
+		if(Fiber_Read(T->null, buf, sizeof(buf)) != sizeof(buf)) T->errors++;
+		if(Fiber_Write(T->null, buf, sizeof(buf)) != sizeof(buf)) T->errors++;
+	}
+	T->io_done++;
+	return 0;
+}
+
+static int fiber_main(int argl, void* args)
+{
+	struct fiber_test* T = args;
+	ASSERT(Fiber_Self() != NULL);
+	for(int i=0; i<100; i++)
+		ASSERT(Fiber_Create(fiber_counter, i, T) != NULL);
+	Fiber_Yield();
+	for(int i=0; i<10; i++)
+		ASSERT(Fiber_Create(fiber_reader, i, T) != NULL);
+	return 42;
+}
+
+BOOT_TEST(test_fibers,
+	"Test that fibers are scheduled round-robin, and that fibers doing I/O\n"
+	"let the others run."
+	)
+{
+	struct fiber_test T = { 0, 0, 0, OpenNull() };
+	ASSERT(Fiber_Run(fiber_main, 0, &T) == 42);
+	ASSERT(T.errors == 0);
+	ASSERT(T.io_done == 10);
+	return 0;
+}
+
+
+struct fiber_poll_test {
+	Fid_t term;
+	int bytes;
+	int threads;		/* the most threads seen while the readers wait */
+};
+
+/* The number of threads of the current process */
+static int my_thread_count()
+{
+	Fid_t info = OpenInfo();
+	procinfo p;
+	int n = 0;
+	while(Read(info, (char*) &p, sizeof(p)) == sizeof(p))
+		if(p.pid == GetPid()) n = p.thread_count;
+	Close(info);
+	return n;
+}
+
+static int fiber_term_reader(int argl, void* args)
+{
+	struct fiber_poll_test* T = args;
+	char c;
+	if(Fiber_Read(T->term, &c, 1) == 1) T->bytes++;
+	return 0;
+}
+
+static int fiber_poll_main(int argl, void* args)
+{
+	struct fiber_poll_test* T = args;
+	for(int i=0; i<50; i++)
+		ASSERT(Fiber_Create(fiber_term_reader, i, T) != NULL);
+
+	/* Let the readers block, and check that they run in this thread */
+	Fiber_Yield();
+	Fiber_Yield();
+	T->threads = my_thread_count();
+	ASSERT(T->bytes == 0);
+
+	char input[51];
+	memset(input, 'x', 50);
+	input[50] = 0;
+	sendme(0, input);
+	return 0;
+}
+
+BOOT_TEST(test_fibers_poll,
+	"Test that fibers blocked on I/O wait together in their own thread, and\n"
+	"that they run when their stream becomes ready.",
+	.minimum_terminals = 1
+	)
+{
+	struct fiber_poll_test T = { OpenTerminal(0), 0, 0 };
+	ASSERT(Fiber_Run(fiber_poll_main, 0, &T) == 0);
+	ASSERT(T.bytes == 50);
+	ASSERT(T.threads == 1);
+	return 0;
+}
+
+
+static void pool_fill(long lo, long hi, void* arg)
+{
+	int* a = arg;
+	for(long i=lo; i<hi; i++) a[i] = i;
+}
+
+static void pool_sum(long lo, long hi, void* acc, void* arg)
+{
+	int* a = arg;
+	for(long i=lo; i<hi; i++) *(long*)acc += a[i];
+}
+
+static void pool_add(void* acc, const void* other, void* arg)
+{
+	*(long*)acc += *(const long*)other;
+}
+
+static ThreadPool* test_pool;
+
+static int pool_fib(int n, void* args)
+{
+	if(n < 2) return n;
+	Future* f = Pool_Submit(test_pool, pool_fib, n-1, NULL);
+	int b = pool_fib(n-2, NULL);
+	return Future_Wait(f) + b;
+}
+
+BOOT_TEST(test_thread_pool,
+	"Test the parallel loops and the nested tasks of a thread pool."
+	)
+{
+	const long N = 10000;
+	int a[N];
+	test_pool = Pool_Create(4);
+	ASSERT(test_pool != NULL);
+
+	Pool_ParallelFor(test_pool, 0, N, 0, pool_fill, a);
+	for(long i=0; i<N; i++) ASSERT(a[i] == i);
+
+	long sum, zero = 0;
+	Pool_ParallelReduce(test_pool, 0, N, 7, sizeof(long), &sum, &zero, pool_sum, pool_add, a);
+	ASSERT(sum == N*(N-1)/2);
+
+	/* Deep recursion of nested futures */
+	ASSERT(pool_fib(15, NULL) == 610);
+
+	Pool_Destroy(test_pool);
+	return 0;
+}
+
+
+static int fid_is_open(int argl, void* args)
+{
+	Fid_t fid = *(Fid_t*)args;
+	return Write(fid, "x", 1) == 1 && Close(fid) == 0 && Write(fid, "x", 1) == -1;
+}
+
+BOOT_TEST(test_many_fids,
+	"Test that a process can use all MAX_FILEID fids, that the lowest free fid\n"
+	"is always allocated, and that children inherit all of them."
+	)
+{
+	for(Fid_t i=0; i<MAX_FILEID; i++)
+		ASSERT(OpenNull() == i);
+	ASSERT(OpenNull() == NOFILE);
+
+	/* Free fids are reused lowest first */
+	ASSERT(Close(1000) == 0);
+	ASSERT(Close(70) == 0);
+	ASSERT(Close(MAX_FILEID-1) == 0);
+	ASSERT(OpenNull() == 70);
+	ASSERT(OpenNull() == 1000);
+	ASSERT(OpenNull() == MAX_FILEID-1);
+
+	for(Fid_t i=1; i<MAX_FILEID; i++)
+		ASSERT(Close(i) == 0);
+
+	/* The table grows for Dup2 */
+	Fid_t high = MAX_FILEID-2;
+	ASSERT(Dup2(0, high) == 0);
+	ASSERT(OpenNull() == 1);
+
+	Pid_t pid = Exec(fid_is_open, sizeof(high), &high);
+	int status;
+	ASSERT(WaitChild(pid, &status) == pid);
+	ASSERT(status == 1);
+	ASSERT(Write(high, "x", 1) == 1);
+	return 0;
+}
+
+
+BOOT_TEST(test_poll,
+	"Test that Poll reports which terminals have input, waiting for it if\n"
+	"needed, and that it times out.",
+	.minimum_terminals = 2
+	)
+{
+	Fid_t term0 = OpenTerminal(0);
+	Fid_t term1 = OpenTerminal(1);
+	Fid_t null = OpenNull();
+	ASSERT(term0 != NOFILE && term1 != NOFILE && null != NOFILE);
+
+	pollfd_t fds[4] = {
+		{ term0, POLL_READ, 0 },
+		{ term1, POLL_READ, 0 },
+		{ null, POLL_WRITE, 0 },
+		{ -1, POLL_READ, 0 }
+	};
+
+	/* Only the null device is ready */
+	ASSERT(Poll(fds, 4, 0) == 1);
+	ASSERT(fds[0].revents == 0 && fds[1].revents == 0);
+	ASSERT(fds[2].revents == POLL_WRITE);
+	ASSERT(fds[3].revents == 0);
+
+	/* Nothing is ready */
+	nsec_t t0 = GetTime();
+	ASSERT(Poll(fds, 2, 50) == 0);
+	ASSERT(GetTime() - t0 >= 50000000ul);
+
+	/* Wait for input */
+	sendme(1, "Hello");
+	ASSERT(Poll(fds, 2, -1) == 1);
+	ASSERT(fds[0].revents == 0);
+	ASSERT(fds[1].revents == POLL_READ);
+	checked_read(term1, "Hello");
+
+	/* A closed fid is invalid */
+	ASSERT(Close(null) == 0);
+	ASSERT(Poll(fds+2, 1, -1) == 1);
+	ASSERT(fds[2].revents == POLL_INVALID);
+	ASSERT(Poll(NULL, 1, 0) == -1);
+	return 0;
+}
+
+
+static int read_two_bytes(int argl, void* args)
+{
+	char buf[2];
+	int n = 0;
+	while(n < 2) {
+		int r = Read(argl, buf+n, 2-n);
+		ASSERT(r > 0);
+		n += r;
+	}
+	ASSERT(memcmp(buf, "ab", 2) == 0);
+	__atomic_store_n((int*) args, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+BOOT_TEST(test_poll_during_read,
+	"Test that a byte read ahead by Poll is not lost or reordered, when\n"
+	"another thread is blocked in Read on the same terminal.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t term = OpenTerminal(0);
+	int done = 0;
+	Tid_t t = CreateThread(read_two_bytes, term, &done);
+
+	/* Let the reader block */
+	Sleep(10000000);
+	sendme(0, "ab");
+
+	pollfd_t fd = { term, POLL_READ, 0 };
+	while(! __atomic_load_n(&done, __ATOMIC_ACQUIRE))
+		Poll(&fd, 1, 0);
+	ASSERT(ThreadJoin(t, NULL) == 0);
+	return 0;
+}
+
+BOOT_TEST(test_epoll,
+	"Test that an epoll interest set reports the ready streams, in the level-triggered\n"
+	"and one-shot modes.",
+	.minimum_terminals = 2
+	)
+{
+	Fid_t term0 = OpenTerminal(0);
+	Fid_t term1 = OpenTerminal(1);
+	Fid_t null = OpenNull();
+	Fid_t ep = EpollCreate();
+	ASSERT(ep != NOFILE);
+
+	int tag0, tag1, tagnull;
+	epoll_event_t ev;
+	epoll_event_t out[4];
+
+	ev = (epoll_event_t){ POLL_READ, &tag0 };
+	ASSERT(EpollCtl(ep, EPOLL_ADD, term0, &ev) == 0);
+	ASSERT(EpollCtl(ep, EPOLL_ADD, term0, &ev) == -1);
+	ev = (epoll_event_t){ POLL_READ, &tag1 };
+	ASSERT(EpollCtl(ep, EPOLL_ADD, term1, &ev) == 0);
+	ev = (epoll_event_t){ POLL_WRITE | POLL_ONESHOT, &tagnull };
+	ASSERT(EpollCtl(ep, EPOLL_ADD, null, &ev) == 0);
+	ASSERT(EpollCtl(ep, EPOLL_ADD, ep, &ev) == -1);
+	ASSERT(EpollCtl(term0, EPOLL_ADD, null, &ev) == -1);
+
+	/* Interest sets cannot be added to one another */
+	Fid_t ep2 = EpollCreate();
+	ASSERT(ep2 != NOFILE);
+	ASSERT(EpollCtl(ep, EPOLL_ADD, ep2, &ev) == -1);
+	ASSERT(EpollCtl(ep2, EPOLL_ADD, ep, &ev) == -1);
+	ASSERT(Close(ep2) == 0);
+
+	/* The one-shot stream is reported once, until re-armed */
+	ASSERT(EpollWait(ep, out, 4, 0) == 1);
+	ASSERT(out[0].events == POLL_WRITE && out[0].data == &tagnull);
+	ASSERT(EpollWait(ep, out, 4, 0) == 0);
+	ASSERT(EpollCtl(ep, EPOLL_MOD, null, &ev) == 0);
+	ASSERT(EpollWait(ep, out, 4, 0) == 1);
+	ASSERT(EpollCtl(ep, EPOLL_DEL, null, NULL) == 0);
+	ASSERT(EpollCtl(ep, EPOLL_DEL, null, NULL) == -1);
+
+	/* Wait for input; a level-triggered stream is reported until it is read */
+	sendme(1, "Hello");
+	ASSERT(EpollWait(ep, out, 4, -1) == 1);
+	ASSERT(out[0].events == POLL_READ && out[0].data == &tag1);
+	ASSERT(EpollWait(ep, out, 4, 0) == 1);
+	ASSERT(out[0].data == &tag1);
+
+	/* The interest set itself can be polled */
+	pollfd_t pfd = { ep, POLL_READ, 0 };
+	ASSERT(Poll(&pfd, 1, 0) == 1);
+
+	checked_read(term1, "Hello");
+	ASSERT(EpollWait(ep, out, 4, 50) == 0);
+
+	/* The size of the output is checked, and bounded by MAX_FILEID */
+	ASSERT(EpollWait(ep, out, 0, 0) == -1);
+	ASSERT(EpollWait(ep, out, (unsigned int)-1, 0) == 0);
+
+	ASSERT(Close(ep) == 0);
+	return 0;
+}
+
+
+BOOT_TEST(test_readv_writev,
+	"Test that ReadV and WriteV scatter and gather the data of a stream, with\n"
+	"vectored drivers and with the fallback for other streams.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t term = OpenTerminal(0);
+	Fid_t null = OpenNull();
+	char head[6], body[5];
+	iovec_t iov[3] = { { head, 6 }, { NULL, 0 }, { body, 5 } };
+
+	/* The null device */
+	memset(head, 'x', 6); memset(body, 'x', 5);
+	ASSERT(ReadV(null, iov, 3) == 11);
+	ASSERT(head[5] == 0 && body[0] == 0);
+	ASSERT(WriteV(null, iov, 3) == 11);
+	ASSERT(ReadV(null, iov, MAX_IOV+1) == -1);
+	ASSERT(ReadV(null, NULL, 1) == -1);
+	ASSERT(ReadV(NOFILE, iov, 3) == -1);
+
+	/* A terminal */
+	sendme(0, "Header:Body!");
+	ASSERT(ReadV(term, iov, 3) == 11);
+	ASSERT(memcmp(head, "Header", 6) == 0);
+	ASSERT(memcmp(body, ":Body", 5) == 0);
+	checked_read(term, "!");
+
+	expect(0, "Header:Body");
+	ASSERT(WriteV(term, iov, 3) == 11);
+
+	/* A stream without vectored methods */
+	Fid_t info = OpenInfo();
+	procinfo p1, p2;
+	iovec_t iov2[2] = { { &p1, sizeof(p1) }, { &p2, sizeof(p2) } };
+	ASSERT(ReadV(info, iov2, 2) == 2*sizeof(procinfo));
+	ASSERT(p1.pid < p2.pid);
+	return 0;
+}
+
+
+BOOT_TEST(test_splice,
+	"Test that Splice moves data between streams.",
+	.minimum_terminals = 2
+	)
+{
+	Fid_t term0 = OpenTerminal(0);
+	Fid_t term1 = OpenTerminal(1);
+	Fid_t null = OpenNull();
+	Fid_t info = OpenInfo();
+
+	/* With SPLICE_ALL, the whole length is moved, in many chunks */
+	ASSERT(Splice(null, null, 10000, SPLICE_ALL) == 10000);
+	ASSERT(Splice(null, null, 0, 0) == 0);
+
+	/* Without it, only the available data is moved */
+	sendme(0, "Hello world");
+	ASSERT(Splice(term0, null, 100, 0) == 11);
+
+	sendme(0, "Hello world");
+	expect(1, "Hello");
+	ASSERT(Splice(term0, term1, 5, 0) == 5);
+	checked_read(term0, " world");
+
+	/* Errors */
+	ASSERT(Splice(NOFILE, null, 10, 0) == -1);
+	ASSERT(Splice(null, NOFILE, 10, 0) == -1);
+	ASSERT(Splice(null, info, 10, 0) == -1);
+	return 0;
+}
+
+
+BOOT_TEST(test_nonblocking_streams,
+	"Test that calls on streams with the STREAM_NONBLOCK flag do not block.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t term = OpenTerminal(0);
+	Fid_t null = OpenNull();
+	char buf[16];
+	iovec_t iov = { buf, 16 };
+
+	ASSERT(GetFlags(term) == 0);
+	ASSERT(SetFlags(term, STREAM_NONBLOCK) == 0);
+	ASSERT(GetFlags(term) == STREAM_NONBLOCK);
+	ASSERT(SetFlags(term, 0x80) == -1);
+	ASSERT(SetFlags(NOFILE, 0) == -1);
+	ASSERT(GetFlags(NOFILE) == -1);
+
+	/* The flags belong to the stream */
+	ASSERT(Dup2(term, 5) == 0);
+	ASSERT(GetFlags(5) == STREAM_NONBLOCK);
+
+	/* Without input */
+	ASSERT(Read(term, buf, 16) == STREAM_WOULDBLOCK);
+	ASSERT(ReadV(term, &iov, 1) == STREAM_WOULDBLOCK);
+	ASSERT(Splice(term, null, 16, SPLICE_ALL) == STREAM_WOULDBLOCK);
+	ASSERT(Read(term, buf, 0) == 0);
+
+	/* Wait for the input, and read it as it arrives */
+	sendme(0, "Hello");
+	int n = 0;
+	while(n < 5) {
+		pollfd_t pfd = { term, POLL_READ, 0 };
+		ASSERT(Poll(&pfd, 1, -1) == 1);
+		int rc = Read(term, buf+n, 16-n);
+		ASSERT(rc > 0 || rc == STREAM_WOULDBLOCK);
+		if(rc > 0) n += rc;
+	}
+	ASSERT(n == 5 && memcmp(buf, "Hello", 5) == 0);
+	ASSERT(Read(term, buf, 16) == STREAM_WOULDBLOCK);
+
+	expect(0, "Hi");
+	ASSERT(Write(term, "Hi", 2) == 2);
+
+	/* Nobody reads the terminal, until its output fills up */
+	char out[4096];
+	memset(out, '.', sizeof(out));
+	iovec_t oiov = { out, sizeof(out) };
+	long written = 0;
+	for(int i=0; i < 1024; i++) {
+		int rc = (i & 1) ? Write(term, out, sizeof(out)) : WriteV(term, &oiov, 1);
+		ASSERT(rc > 0 || rc == STREAM_WOULDBLOCK);
+		if(rc == STREAM_WOULDBLOCK) break;
+		written += rc;
+	}
+	ASSERT(written < 1024*sizeof(out));
+	ASSERT(Write(term, out, 1) == STREAM_WOULDBLOCK);
+
+	/* Streams that never block are not affected */
+	ASSERT(SetFlags(null, STREAM_NONBLOCK) == 0);
+	ASSERT(Read(null, buf, 16) == 16);
+
+	ASSERT(SetFlags(5, 0) == 0);
+	ASSERT(GetFlags(term) == 0);
+	return 0;
+}
+
+
+/* A thread that stays in an RCU read-side section, until told to leave */
+static struct { int in_section, leave, left, done; } rcu_test;
+
+static int rcu_reader(int argl, void* args)
+{
+	int rcu = rcu_read_lock();
+	__atomic_store_n(& rcu_test.in_section, 1, __ATOMIC_SEQ_CST);
+	/* Do not hang a single core for ever */
+	TimerDuration end = bios_clock_ns() + 200000000ull;
+	while(! __atomic_load_n(& rcu_test.leave, __ATOMIC_SEQ_CST) && bios_clock_ns() < end);
+	__atomic_store_n(& rcu_test.left, 1, __ATOMIC_SEQ_CST);
+	rcu_read_unlock(rcu);
+	return 0;
+}
+
+static void rcu_test_callback(void* obj)
+{
+	__atomic_store_n((int*) obj, 1, __ATOMIC_SEQ_CST);
+}
+
+BOOT_TEST(test_rcu_grace_period,
+	"Test that a deferred RCU callback is not executed while a read-side section\n"
+	"of another core is active, and that it is executed after it ends."
+	)
+{
+	static rcu_callback cb;
+	memset(&rcu_test, 0, sizeof(rcu_test));
+
+	Tid_t t = CreateThread(rcu_reader, 0, NULL);
+	while(! __atomic_load_n(& rcu_test.in_section, __ATOMIC_SEQ_CST))
+		Sleep(100000);
+
+	rcu_defer(&cb, rcu_test_callback, & rcu_test.done);
+
+	/* Our own core passes quiescent states, the reader's core does not */
+	for(int i=0; i<10; i++) Sleep(100000);
+	int done = __atomic_load_n(& rcu_test.done, __ATOMIC_SEQ_CST);
+	int left = __atomic_load_n(& rcu_test.left, __ATOMIC_SEQ_CST);
+	if(! left) ASSERT(! done);
+
+	__atomic_store_n(& rcu_test.leave, 1, __ATOMIC_SEQ_CST);
+	ASSERT(ThreadJoin(t, NULL) == 0);
+	for(int i=0; i<1000 && ! __atomic_load_n(& rcu_test.done, __ATOMIC_SEQ_CST); i++)
+		Sleep(1000000);
+	ASSERT(rcu_test.done);
+	return 0;
+}
+
+
+/* 
+	Threads lock a mutex with short and long hold times, and many mutexes,
+	more than the slots of the kernel's spinning hints.
+ */
+#define MUTEX_TEST_LOCKS 3000
+
+static struct {
+	Mutex mx;
+	int inside;
+	unsigned int count;
+	Mutex locks[MUTEX_TEST_LOCKS];
+	unsigned int counts[MUTEX_TEST_LOCKS];
+} mutex_test;
+
+static int mutex_contention_thread(int argl, void* args)
+{
+	for(int i=0; i<2000; i++) {
+		Mutex_Lock(& mutex_test.mx);
+		ASSERT(mutex_test.inside++ == 0);
+		mutex_test.count++;
+		/* Sometimes, hold the mutex for long */
+		if(i % 200 == argl) Sleep(200000);
+		mutex_test.inside--;
+		Mutex_Unlock(& mutex_test.mx);
+
+		unsigned int k = (i * 7919u + argl) % MUTEX_TEST_LOCKS;
+		Mutex_Lock(& mutex_test.locks[k]);
+		mutex_test.counts[k]++;
+		Mutex_Unlock(& mutex_test.locks[k]);
+	}
+	return 0;
+}
+
+BOOT_TEST(test_mutex_contention,
+	"Test mutual exclusion of contended mutexes with short and long hold times,\n"
+	"and that a Mutex is still a byte, initialized by plain assignment."
+	)
+{
+	const int N = 6;
+	ASSERT(sizeof(Mutex) == 1);
+	memset(&mutex_test, 0, sizeof(mutex_test));
+	mutex_test.mx = MUTEX_INIT;
+	for(int k=0; k<MUTEX_TEST_LOCKS; k++)
+		mutex_test.locks[k] = MUTEX_INIT;
+
+	Tid_t tids[N];
+	for(int i=0; i<N; i++)
+		tids[i] = CreateThread(mutex_contention_thread, i, NULL);
+	for(int i=0; i<N; i++)
+		ASSERT(ThreadJoin(tids[i], NULL) == 0);
+
+	ASSERT(mutex_test.count == N*2000);
+	unsigned int total = 0;
+	for(int k=0; k<MUTEX_TEST_LOCKS; k++)
+		total += mutex_test.counts[k];
+	ASSERT(total == N*2000);
+	return 0;
+}
+
+
 TEST_SUITE(user_tests, 
 	"These are tests defined by the user."
 	)
 {
 	&dummy_user_test,
+	&test_cond_broadcast_chain,
+	&test_barrier_phases,
+	&test_read_races_close,
+	&test_sleep_deadlines,
+	&test_pid_no_immediate_reuse,
+	&test_procinfo_stream,
+	&test_stale_tids_rejected,
+	&test_execmany,
+	&test_waitchildren,
+	&test_waitchild_many_waiters,
+	&test_process_usage,
+	&test_exec_private_args,
+	&test_kill_group,
+	&test_kill_blocked_io,
+	&test_tls,
+	&test_fibers,
+	&test_fibers_poll,
+	&test_thread_pool,
+	&test_many_fids,
+	&test_poll,
+	&test_poll_during_read,
+	&test_epoll,
+	&test_readv_writev,
+	&test_splice,
+	&test_nonblocking_streams,
+	&test_rcu_grace_period,
+	&test_mutex_contention,
 	NULL
 };
 